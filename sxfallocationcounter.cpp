@@ -0,0 +1,131 @@
+#include "sxfallocationcounter.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<qint64> allocationCount{0};
+
+    void countAllocation() {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+qint64 sxfAllocationCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+#if defined(__GLIBC__)
+
+#include <malloc.h>
+
+namespace {
+    // One arena, so mallinfo() also sees what the decoding threads allocate
+    struct SingleArena {
+        SingleArena() { mallopt(M_ARENA_MAX, 1); }
+    } singleArena;
+}
+
+// glibc lets the executable interpose malloc() and still reach its own allocator
+// through the __libc_ entry points. operator new and QArrayData both end up here.
+// free() is left alone, these blocks come from the regular heap.
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* memory, size_t size);
+    void* __libc_memalign(size_t alignment, size_t size);
+
+    void* malloc(size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* memory, size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_realloc(memory, size);
+    }
+
+    void* memalign(size_t alignment, size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(size_t alignment, size_t size) noexcept
+    {
+        countAllocation();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** memory, size_t alignment, size_t size) noexcept
+    {
+        if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0)
+            return EINVAL;
+        countAllocation();
+        void* aligned = __libc_memalign(alignment, size);
+        if (!aligned)
+            return ENOMEM;
+        *memory = aligned;
+        return 0;
+    }
+}
+
+bool sxfAllocationCountIncludesMalloc()
+{
+    return true;
+}
+
+qint64 sxfHeapInUse()
+{
+#if __GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33)
+    const struct mallinfo2 info = mallinfo2();
+    return qint64(info.uordblks) + qint64(info.hblkhd);
+#else
+    const struct mallinfo info = mallinfo();
+    return qint64(unsigned(info.uordblks)) + qint64(unsigned(info.hblkhd));
+#endif
+}
+
+#else
+
+// No portable way to interpose malloc(), count operator new only
+void* operator new(std::size_t size)
+{
+    countAllocation();
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+bool sxfAllocationCountIncludesMalloc()
+{
+    return false;
+}
+
+qint64 sxfHeapInUse()
+{
+    return -1;
+}
+
+#endif
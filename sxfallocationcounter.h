@@ -0,0 +1,18 @@
+#ifndef SXFALLOCATIONCOUNTER_H
+#define SXFALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+// Heap allocations made by the whole process so far. Linking this file replaces
+// the process allocator entry points, so only the sxfbench target does.
+qint64 sxfAllocationCount();
+
+// With glibc malloc() itself is counted, which includes Qt containers. Elsewhere
+// only operator new is, Qt containers allocate with malloc() and are missed.
+bool sxfAllocationCountIncludesMalloc();
+
+// Heap bytes in use by the whole process, -1 where the allocator can't tell.
+// With glibc every thread shares one malloc arena so the count covers them all.
+qint64 sxfHeapInUse();
+
+#endif // SXFALLOCATIONCOUNTER_H
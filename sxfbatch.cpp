@@ -0,0 +1,192 @@
+#include "sxfprocessor.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QMutex>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <atomic>
+#include <stdexcept>
+
+/**
+ * @brief Headless batch processing of SXF files, for machines without a display.
+ *
+ * validate  loads every file and decodes both sheets.
+ * normalize re-encodes every file in place.
+ * convert   re-encodes every file into --output, keeping the directory layout.
+ *
+ * Load timing and allocation counts live in the separate sxfbench tool.
+ */
+
+namespace {
+    enum class BatchMode { Validate, Normalize, Convert };
+
+    struct BatchJob {
+        BatchMode mode;
+        QDir inputRoot;
+        QDir outputRoot;
+        SxfSaveOptions saveOptions;
+    };
+
+    struct BatchStats {
+        std::atomic<int> succeeded{0};
+        std::atomic<int> failed{0};
+        std::atomic<qint64> bytes{0};
+    };
+
+    QMutex outputMutex;
+
+    void report(const QString& line, bool error) {
+        QMutexLocker locker(&outputMutex);
+        QTextStream stream(error ? stderr : stdout);
+        stream << line << Qt::endl;
+    }
+
+    // Returns an optional detail for the report line
+    QString processFile(const BatchJob& job, const QString& filePath) {
+        // Decode on this worker only, so --jobs bounds the threads of the whole run
+        SxfData data = loadSxf(filePath);
+        data.decodeSheets(SxfProgressCallback(), false);
+        if (job.mode == BatchMode::Validate)
+            return QString();
+
+        QString targetPath = filePath;
+        if (job.mode == BatchMode::Convert) {
+            targetPath = job.outputRoot.filePath(job.inputRoot.relativeFilePath(filePath));
+            if (!QDir().mkpath(QFileInfo(targetPath).absolutePath())) {
+                QString errorMsg = QString("Failed to create directory for: %1").arg(targetPath);
+                throw std::runtime_error(errorMsg.toStdString());
+            }
+        }
+
+        // Drop the source so every known block is re-encoded instead of copied
+        // verbatim. Unknown blocks and the reserved sound bytes are still copied
+        // as read and keep slices of it, so release the mapping first: saveSxf()
+        // can't once the pointer is gone, and Windows won't replace a mapped file.
+        releaseSxfSource(data, targetPath);
+        data.source.clear();
+        saveSxf(targetPath, data, job.saveOptions);
+        return QString();
+    }
+
+    class BatchTask : public QRunnable {
+    public:
+        BatchTask(const BatchJob& job, const QString& filePath, BatchStats& stats)
+            : m_job(job), m_filePath(filePath), m_stats(stats) {}
+
+        void run() override {
+            QElapsedTimer timer;
+            timer.start();
+            try {
+                const QString detail = processFile(m_job, m_filePath);
+                m_stats.succeeded++;
+                m_stats.bytes += QFileInfo(m_filePath).size();
+                report(QString("OK    %1 (%2)").arg(m_filePath,
+                    detail.isEmpty() ? QString("%1 ms").arg(timer.elapsed()) : detail), false);
+            }
+            catch (const std::exception& e) {
+                m_stats.failed++;
+                report(QString("FAIL  %1: %2").arg(m_filePath, QString::fromStdString(e.what())), true);
+            }
+        }
+
+    private:
+        const BatchJob& m_job;
+        QString m_filePath;
+        BatchStats& m_stats;
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sxfbatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Validate, normalize or convert SXF files without a GUI.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("mode", "validate, normalize or convert");
+    parser.addPositionalArgument("path", "SXF file or directory searched recursively");
+    QCommandLineOption outputOption({"o", "output"}, "Output directory for convert.", "dir");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Number of files processed at once.", "count",
+                                  QString::number(QThread::idealThreadCount()));
+    QCommandLineOption trimOption("trim", "Drop trailing empty cells when saving.");
+    parser.addOption(outputOption);
+    parser.addOption(jobsOption);
+    parser.addOption(trimOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2) {
+        parser.showHelp(2);
+    }
+
+    BatchJob job;
+    const QString modeName = args.at(0);
+    if (modeName == "validate") {
+        job.mode = BatchMode::Validate;
+    } else if (modeName == "normalize") {
+        job.mode = BatchMode::Normalize;
+    } else if (modeName == "convert") {
+        job.mode = BatchMode::Convert;
+    } else {
+        report(QString("Unknown mode: %1").arg(modeName), true);
+        return 2;
+    }
+    if (job.mode == BatchMode::Convert && !parser.isSet(outputOption)) {
+        report("convert needs --output.", true);
+        return 2;
+    }
+    bool jobsOk = false;
+    int jobs = parser.value(jobsOption).toInt(&jobsOk);
+    if (!jobsOk || jobs < 1) {
+        report(QString("Invalid job count: %1").arg(parser.value(jobsOption)), true);
+        return 2;
+    }
+    job.outputRoot = QDir(parser.value(outputOption));
+    job.saveOptions.trimTrailingEmptyCells = parser.isSet(trimOption);
+
+    QStringList files;
+    const QFileInfo input(args.at(1));
+    if (input.isDir()) {
+        job.inputRoot = QDir(input.absoluteFilePath());
+        QDirIterator it(input.absoluteFilePath(), {"*.sxf"}, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            files.append(it.next());
+        }
+        files.sort();
+    } else if (input.isFile()) {
+        job.inputRoot = input.absoluteDir();
+        files.append(input.absoluteFilePath());
+    } else {
+        report(QString("No such file or directory: %1").arg(args.at(1)), true);
+        return 2;
+    }
+
+    BatchStats stats;
+    QElapsedTimer timer;
+    timer.start();
+
+    // Own pool so the worker count stays bounded regardless of the global pool
+    QThreadPool pool;
+    pool.setMaxThreadCount(jobs);
+    for (const QString& filePath : files) {
+        pool.start(new BatchTask(job, filePath, stats));
+    }
+    pool.waitForDone();
+
+    const double seconds = qMax<qint64>(timer.elapsed(), 1) / 1000.0;
+    report(QString("%1 files, %2 ok, %3 failed in %4 s (%5 files/s, %6 MB/s)")
+               .arg(files.size()).arg(stats.succeeded.load()).arg(stats.failed.load())
+               .arg(seconds, 0, 'f', 2)
+               .arg(files.size() / seconds, 0, 'f', 1)
+               .arg(stats.bytes.load() / seconds / (1024.0 * 1024.0), 0, 'f', 1), false);
+
+    return stats.failed > 0 ? 1 : 0;
+}
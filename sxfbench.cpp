@@ -0,0 +1,274 @@
+#include "sxfprocessor.h"
+#include "sxfcellcodec.h"
+#include "sxfallocationcounter.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTextStream>
+#include <stdexcept>
+
+/**
+ * @brief Load benchmark for SXF files.
+ *
+ * Loads every file --iterations times in the chosen --mode, one file at a time,
+ * and reports the time, the heap allocations and the heap bytes per load. It then
+ * scans every cell and encodes every column of one loaded copy. --compare-storage
+ * repeats scan and encode on the cells copied into the QList<SxfCell> columns
+ * the editor used before run-length encoding.
+ *
+ * Counting allocations replaces the process allocator (see sxfallocationcounter.h),
+ * so this is a tool of its own rather than a mode of sxfbatch.
+ */
+
+namespace {
+    struct BenchOptions {
+        int iterations = 10;
+        SxfLoadMode mode = SxfLoadMode::Mapped;
+        bool compareStorage = false;
+    };
+
+    void report(const QString& line, bool error) {
+        QTextStream stream(error ? stderr : stdout);
+        stream << line << Qt::endl;
+    }
+
+    QString formatBytes(qint64 bytes) {
+        return bytes < 0 ? QString("n/a") : QString("%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+    }
+
+    // Milliseconds per iteration of the QElapsedTimer started before the loop
+    double perIteration(const QElapsedTimer& timer, int iterations) {
+        return double(timer.nsecsElapsed()) / 1e6 / iterations;
+    }
+
+    // The cells of one column as the editor stored them before run-length encoding
+    using SxfCellList = QList<SxfCell>;
+
+    struct ScanEncodeResult {
+        double scanMs = 0;
+        double encodeMs = 0;
+        quint64 checksum = 0;
+    };
+
+    // Reads every cell row by row, like the view does, then encodes every column
+    ScanEncodeResult scanAndEncode(const QVector<SxfColumn>& columns, int iterations) {
+        ScanEncodeResult result;
+        int maxCells = 0;
+        for (const SxfColumn& column : columns) {
+            maxCells = qMax(maxCells, column.cellCount());
+        }
+        QByteArray buffer(maxCells * SXF_CELL_SIZE, Qt::Uninitialized);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            result.checksum = 0;
+            for (const SxfColumn& column : columns) {
+                for (int row = 0; row < column.cellCount(); ++row) {
+                    const SxfCell cell = column.cell(row);
+                    result.checksum += cell.mark * 31u + cell.frameIndex;
+                }
+            }
+        }
+        result.scanMs = perIteration(timer, iterations);
+
+        timer.restart();
+        for (int i = 0; i < iterations; ++i) {
+            for (const SxfColumn& column : columns) {
+                column.encodeCells(reinterpret_cast<uchar*>(buffer.data()), column.cellCount());
+            }
+        }
+        result.encodeMs = perIteration(timer, iterations);
+        return result;
+    }
+
+    ScanEncodeResult scanAndEncode(const QVector<SxfCellList>& columns, int iterations) {
+        ScanEncodeResult result;
+        int maxCells = 0;
+        for (const SxfCellList& column : columns) {
+            maxCells = qMax(maxCells, column.size());
+        }
+        QByteArray buffer(maxCells * SXF_CELL_SIZE, Qt::Uninitialized);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; ++i) {
+            result.checksum = 0;
+            for (const SxfCellList& column : columns) {
+                for (int row = 0; row < column.size(); ++row) {
+                    const SxfCell& cell = column.at(row);
+                    result.checksum += cell.mark * 31u + cell.frameIndex;
+                }
+            }
+        }
+        result.scanMs = perIteration(timer, iterations);
+
+        // The per-cell writer the batch encoder replaced
+        timer.restart();
+        for (int i = 0; i < iterations; ++i) {
+            for (const SxfCellList& column : columns) {
+                uchar* dst = reinterpret_cast<uchar*>(buffer.data());
+                for (const SxfCell& cell : column) {
+                    encodeSxfCellRun(cell.mark, cell.frameIndex, 1, dst);
+                    dst += SXF_CELL_SIZE;
+                }
+            }
+        }
+        result.encodeMs = perIteration(timer, iterations);
+        return result;
+    }
+
+    // Returns the timing, allocation and storage summary of one file
+    QString benchmarkFile(const QString& filePath, const BenchOptions& options) {
+        qint64 allocations = 0;
+        qint64 heapBytes = 0;
+        int arenaBlocks = 0;
+        int columnCount = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < options.iterations; ++i) {
+            const qint64 allocationsBefore = sxfAllocationCount();
+            const qint64 heapBefore = sxfHeapInUse();
+            {
+                SxfData data = loadSxf(filePath, options.mode);
+                data.decodeSheets();
+                heapBytes = heapBefore < 0 ? -1 : sxfHeapInUse() - heapBefore;
+                if (data.arena)
+                    arenaBlocks = data.arena->blockCount();
+                columnCount = data.actionSheet.columns().size() + data.cellSheet.columns().size();
+            }
+            allocations += sxfAllocationCount() - allocationsBefore;
+        }
+        const double loadMs = perIteration(timer, options.iterations);
+
+        // Per column too: loading should cost a handful of allocations plus about
+        // one per column, for its name
+        const double perLoad = double(allocations) / options.iterations;
+        QString summary = QString("%1 ms/load, %2 %3/load, %4 per column, %5 columns, %6 arena blocks, %7 heap")
+            .arg(loadMs, 0, 'f', 2)
+            .arg(qint64(perLoad))
+            .arg(sxfAllocationCountIncludesMalloc() ? "allocations" : "operator new calls")
+            .arg(perLoad / qMax(columnCount, 1), 0, 'f', 2)
+            .arg(columnCount)
+            .arg(arenaBlocks)
+            .arg(formatBytes(heapBytes));
+
+        // Scan and encode one loaded copy, paged columns are decoded through the cache
+        SxfData data = loadSxf(filePath, options.mode);
+        data.decodeSheets();
+        QVector<SxfColumn> columns;
+        columns.reserve(columnCount);
+        qint64 cells = 0;
+        qint64 runs = 0;
+        for (const SxfSheet* sheet : { &data.actionSheet, &data.cellSheet }) {
+            for (int i = 0; i < sheet->columns().size(); ++i) {
+                columns.append(sheet->column(i));
+                cells += columns.last().cellCount();
+                runs += columns.last().runCount();
+            }
+        }
+        const ScanEncodeResult runResult = scanAndEncode(columns, options.iterations);
+        summary += QString("; %1 cells in %2 runs, scan %3 ms, encode %4 ms")
+            .arg(cells).arg(runs)
+            .arg(runResult.scanMs, 0, 'f', 2)
+            .arg(runResult.encodeMs, 0, 'f', 2);
+
+        if (options.compareStorage) {
+            const qint64 heapBefore = sxfHeapInUse();
+            QVector<SxfCellList> lists;
+            lists.reserve(columns.size());
+            for (const SxfColumn& column : columns) {
+                SxfCellList cellList;
+                cellList.reserve(column.cellCount());
+                for (int row = 0; row < column.cellCount(); ++row) {
+                    cellList.append(column.cell(row));
+                }
+                lists.append(cellList);
+            }
+            const qint64 listBytes = heapBefore < 0 ? -1 : sxfHeapInUse() - heapBefore;
+            const ScanEncodeResult listResult = scanAndEncode(lists, options.iterations);
+            if (listResult.checksum != runResult.checksum)
+                throw std::runtime_error("QList<SxfCell> copy does not match the run-length columns.");
+            summary += QString("; QList<SxfCell>: %1 heap, scan %2 ms, encode %3 ms")
+                .arg(formatBytes(listBytes))
+                .arg(listResult.scanMs, 0, 'f', 2)
+                .arg(listResult.encodeMs, 0, 'f', 2);
+        }
+        return summary;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("sxfbench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measure load time, heap use and cell access of SXF files.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("path", "SXF file or directory searched recursively");
+    QCommandLineOption iterationsOption({"n", "iterations"}, "Loads, scans and encodes per file.", "count", "10");
+    QCommandLineOption modeOption({"m", "mode"}, "Load mode: stream, mapped or paged.", "mode", "mapped");
+    QCommandLineOption compareOption("compare-storage", "Also scan and encode the cells as QList<SxfCell> columns.");
+    parser.addOption(iterationsOption);
+    parser.addOption(modeOption);
+    parser.addOption(compareOption);
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 1) {
+        parser.showHelp(2);
+    }
+
+    BenchOptions options;
+    bool iterationsOk = false;
+    options.iterations = parser.value(iterationsOption).toInt(&iterationsOk);
+    if (!iterationsOk || options.iterations < 1) {
+        report(QString("Invalid iteration count: %1").arg(parser.value(iterationsOption)), true);
+        return 2;
+    }
+    const QString modeName = parser.value(modeOption);
+    if (modeName == "stream") {
+        options.mode = SxfLoadMode::Stream;
+    } else if (modeName == "mapped") {
+        options.mode = SxfLoadMode::Mapped;
+    } else if (modeName == "paged") {
+        options.mode = SxfLoadMode::Paged;
+    } else {
+        report(QString("Unknown mode: %1").arg(modeName), true);
+        return 2;
+    }
+    options.compareStorage = parser.isSet(compareOption);
+
+    QStringList files;
+    const QFileInfo input(args.at(0));
+    if (input.isDir()) {
+        QDirIterator it(input.absoluteFilePath(), {"*.sxf"}, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            files.append(it.next());
+        }
+        files.sort();
+    } else if (input.isFile()) {
+        files.append(input.absoluteFilePath());
+    } else {
+        report(QString("No such file or directory: %1").arg(args.at(0)), true);
+        return 2;
+    }
+
+    // The allocation counter is process-wide, files are loaded one at a time
+    int failed = 0;
+    for (const QString& filePath : files) {
+        try {
+            report(QString("OK    %1 (%2)").arg(filePath, benchmarkFile(filePath, options)), false);
+        }
+        catch (const std::exception& e) {
+            failed++;
+            report(QString("FAIL  %1: %2").arg(filePath, QString::fromStdString(e.what())), true);
+        }
+    }
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,125 @@
+#include "sxfcellcodec.h"
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SXF_CELL_CODEC_SSE2
+#endif
+
+namespace {
+	bool isAsciiSpace(uchar c) {
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
+
+	// Scalar path: accepts what QByteArray::toUInt() accepts on the text before
+	// the first NUL (surrounding whitespace, an optional '+', decimal digits).
+	quint32 parseFrameIndex(const uchar* ascii) {
+		int length = 0;
+		while (length < 8 && ascii[length] != 0) {
+			++length;
+		}
+
+		int i = 0;
+		while (i < length && isAsciiSpace(ascii[i])) {
+			++i;
+		}
+		if (i < length && ascii[i] == '+') {
+			++i;
+		}
+
+		const int digitsStart = i;
+		quint32 value = 0;
+		while (i < length && ascii[i] >= '0' && ascii[i] <= '9') {
+			value = value * 10 + (ascii[i] - '0');
+			++i;
+		}
+		if (i == digitsStart) {
+			return 0;
+		}
+
+		while (i < length && isAsciiSpace(ascii[i])) {
+			++i;
+		}
+		return i == length ? value : 0;
+	}
+
+#ifdef SXF_CELL_CODEC_SSE2
+	// Classifies the 8 bytes at once and converts the common "digits then NUL
+	// padding" layout without branching per digit; anything else goes to the scalar path.
+	quint32 decodeFrameIndex(const uchar* ascii) {
+		const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(ascii));
+		const __m128i nine = _mm_set1_epi8(9);
+		const __m128i digits = _mm_sub_epi8(bytes, _mm_set1_epi8('0'));
+		const quint32 digitMask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(digits, nine), nine)) & 0xFF;
+		const quint32 nulMask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128())) & 0xFF;
+
+		if (nulMask == 0xFF) {
+			return 0;// Empty cell
+		}
+		if (digitMask == 0 || (digitMask & (digitMask + 1)) != 0 || (digitMask | nulMask) != 0xFF) {
+			return parseFrameIndex(ascii);
+		}
+
+		// Right-align the digit values in a little-endian word, then fold pairs,
+		// quads and the final two halves: the leading NUL bytes act as zeros.
+		const int digitCount = qPopulationCount(digitMask);
+		quint64 value;
+		memcpy(&value, ascii, 8);
+		value &= 0x0F0F0F0F0F0F0F0FULL;
+		value <<= 8 * (8 - digitCount);
+		value = ((value * 2561) >> 8) & 0x00FF00FF00FF00FFULL;
+		value = ((value * 6553601) >> 16) & 0x0000FFFF0000FFFFULL;
+		value = (value * 42949672960001ULL) >> 32;
+		return static_cast<quint32>(value);
+	}
+#else
+	quint32 decodeFrameIndex(const uchar* ascii) {
+		return parseFrameIndex(ascii);
+	}
+#endif
+
+	void encodeFrameIndex(quint32 frameIndex, uchar* ascii) {
+		memset(ascii, 0, 8);
+		if (frameIndex == 0) {
+			return;
+		}
+
+		// quint32 has at most 10 digits, fill them from the end
+		char digits[10];
+		int start = sizeof(digits);
+		do {
+			digits[--start] = static_cast<char>('0' + frameIndex % 10);
+			frameIndex /= 10;
+		} while (frameIndex != 0);
+
+		memcpy(ascii, digits + start, qMin<int>(sizeof(digits) - start, 8));
+	}
+}
+
+void decodeSxfCells(const uchar* src, quint32 count, quint16* marks, quint32* frameIndices)
+{
+	for (quint32 i = 0; i < count; ++i, src += SXF_CELL_SIZE) {
+		marks[i] = qFromBigEndian<quint16>(src);
+		frameIndices[i] = decodeFrameIndex(src + 2);
+	}
+}
+
+void encodeSxfCellRun(quint16 mark, quint32 frameIndex, quint32 count, uchar* dst)
+{
+	if (count == 0) {
+		return;
+	}
+
+	qToBigEndian<quint16>(mark, dst);
+	encodeFrameIndex(frameIndex, dst + 2);
+
+	// Replicate the first record, doubling the copied span each time
+	quint32 done = 1;
+	while (done < count) {
+		const quint32 chunk = qMin(done, count - done);
+		memcpy(dst + done * SXF_CELL_SIZE, dst, chunk * SXF_CELL_SIZE);
+		done += chunk;
+	}
+}
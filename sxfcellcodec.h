@@ -0,0 +1,18 @@
+#ifndef SXFCELLCODEC_H
+#define SXFCELLCODEC_H
+
+#include "sxfprocessor.h"
+
+// One cell record: big-endian mark (2 bytes) + frame index as NUL-padded ASCII (8 bytes)
+const int SXF_CELL_SIZE = 10;
+
+// Decodes count consecutive cell records of a column from src into the two cell arrays.
+// A frame index that is not a plain decimal number decodes to 0, like QByteArray::toUInt().
+void decodeSxfCells(const uchar* src, quint32 count, quint16* marks, quint32* frameIndices);
+
+// Encodes count identical cells into dst, which must hold count * SXF_CELL_SIZE bytes.
+// Byte-identical to the original per-cell writer, including keeping only the
+// first 8 digits of a frame index that does not fit.
+void encodeSxfCellRun(quint16 mark, quint32 frameIndex, quint32 count, uchar* dst);
+
+#endif // SXFCELLCODEC_H
@@ -0,0 +1,160 @@
+#include "sxfcelldelegate.h"
+#include "sxfmodel.h"
+#include <QPainter>
+#include <QFontMetricsF>
+#include <QApplication>
+#include <QStyle>
+#include <QStyleOptionFocusRect>
+
+SxfCellDelegate::SxfCellDelegate(QObject* parent)
+    : QStyledItemDelegate(parent)
+{
+}
+
+int SxfCellDelegate::markSlot(quint16 mark)
+{
+    switch (mark) {
+    case CellMark::KeyFrame: return 0;
+    case CellMark::Inbetween: return 1;
+    case CellMark::Inbetween2: return 2;
+    case CellMark::Stop: return 3;
+    default: return -1;
+    }
+}
+
+/**
+ * @brief Lays out the digit and mark glyphs for font, only when the font changed.
+ */
+void SxfCellDelegate::prepareGlyphs(const QFont& font) const
+{
+    if (m_glyphsReady && font == m_font)
+        return;
+
+    m_font = font;
+    QFontMetricsF metrics(font);
+    for (int digit = 0; digit < 10; ++digit) {
+        m_digits[digit] = QStaticText(QString(QChar('0' + digit)));
+        m_digits[digit].setTextFormat(Qt::PlainText);
+        m_digits[digit].prepare(QTransform(), font);
+        m_digitWidths[digit] = metrics.horizontalAdvance(QChar('0' + digit));
+    }
+
+    const quint16 marks[] = { CellMark::KeyFrame, CellMark::Inbetween, CellMark::Inbetween2, CellMark::Stop };
+    for (quint16 mark : marks) {
+        const int slot = markSlot(mark);
+        const QString symbol = SxfModel::markSymbol(mark);
+        m_marks[slot] = QStaticText(symbol);
+        m_marks[slot].setTextFormat(Qt::PlainText);
+        m_marks[slot].prepare(QTransform(), font);
+        m_markWidths[slot] = metrics.horizontalAdvance(symbol);
+    }
+
+    m_spaceWidth = metrics.horizontalAdvance(QChar(' '));
+    m_textHeight = metrics.height();
+    m_glyphsReady = true;
+}
+
+/**
+ * @brief Cached pens, a new QPen would allocate on every cell.
+ */
+const QPen& SxfCellDelegate::textPen(const QStyleOptionViewItem& option) const
+{
+    const QPalette::ColorGroup group = option.state & QStyle::State_Enabled ? QPalette::Normal : QPalette::Disabled;
+    const bool selected = option.state & QStyle::State_Selected;
+    const QColor& color = option.palette.color(group, selected ? QPalette::HighlightedText : QPalette::Text);
+    QPen& pen = selected ? m_selectedTextPen : m_textPen;
+    if (pen.color() != color)
+        pen = QPen(color);
+    return pen;
+}
+
+void SxfCellDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const
+{
+    const QVariant raw = index.data(SxfModel::RawCellRole);
+    if (!raw.isValid()) {
+        QStyledItemDelegate::paint(painter, option, index);
+        return;
+    }
+
+    // Background and selection come from the style, without initStyleOption()
+    // which would fetch and format the display text
+    const QWidget* widget = option.widget;
+    QStyle* style = widget ? widget->style() : QApplication::style();
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &option, painter, widget);
+
+    const SxfCell cell = SxfModel::unpackCell(raw.value<quint64>());
+    if (cell.mark == 0 && cell.frameIndex == 0) {
+        drawFocus(painter, option, style);
+        return;
+    }
+
+    prepareGlyphs(option.font);
+
+    // Digits of frameIndex, least significant first
+    int digits[10];
+    int digitCount = 0;
+    quint32 value = cell.frameIndex;
+    do {
+        digits[digitCount++] = value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    const int slot = markSlot(cell.mark);
+    qreal width = 0;
+    if (slot >= 0)
+        width += m_markWidths[slot] + m_spaceWidth;
+    for (int i = 0; i < digitCount; ++i)
+        width += m_digitWidths[digits[i]];
+
+    // Aligned like the default delegate: Qt::TextAlignmentRole, else the view's
+    // alignment, inside the same horizontal text margin. Left aligned when too wide.
+    const QVariant alignmentValue = index.data(Qt::TextAlignmentRole);
+    const Qt::Alignment alignment = alignmentValue.isValid()
+        ? Qt::Alignment(alignmentValue.toInt())
+        : option.displayAlignment;
+    const int margin = style->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, widget) + 1;
+    const QRectF rect = QRectF(option.rect).adjusted(margin, 0, -margin, 0);
+    const qreal free = qMax<qreal>(0, rect.width() - width);
+    const Qt::Alignment horizontal = QStyle::visualAlignment(option.direction, alignment) & Qt::AlignHorizontal_Mask;
+    qreal x = rect.left();
+    if (horizontal & Qt::AlignHCenter)
+        x += free / 2;
+    else if (horizontal & Qt::AlignRight)
+        x += free;
+    qreal y = rect.top() + (rect.height() - m_textHeight) / 2;
+    if (alignment & Qt::AlignTop)
+        y = rect.top();
+    else if (alignment & Qt::AlignBottom)
+        y = rect.bottom() - m_textHeight;
+
+    // painter->save() would allocate a state, put the pen back by hand instead
+    const QPen oldPen = painter->pen();
+    painter->setPen(textPen(option));
+    if (slot >= 0) {
+        painter->drawStaticText(QPointF(x, y), m_marks[slot]);
+        x += m_markWidths[slot] + m_spaceWidth;
+    }
+    for (int i = digitCount - 1; i >= 0; --i) {
+        painter->drawStaticText(QPointF(x, y), m_digits[digits[i]]);
+        x += m_digitWidths[digits[i]];
+    }
+    painter->setPen(oldPen);
+
+    drawFocus(painter, option, style);
+}
+
+/**
+ * @brief Draws the focus frame like QStyle::CE_ItemViewItem does for the current item.
+ */
+void SxfCellDelegate::drawFocus(QPainter* painter, const QStyleOptionViewItem& option, const QStyle* style) const
+{
+    if (!(option.state & QStyle::State_HasFocus))
+        return;
+
+    QStyleOptionFocusRect focus;
+    focus.QStyleOption::operator=(option);
+    focus.state |= QStyle::State_KeyboardFocusChange | QStyle::State_Item;
+    const QPalette::ColorGroup group = option.state & QStyle::State_Enabled ? QPalette::Normal : QPalette::Disabled;
+    focus.backgroundColor = option.palette.color(group, option.state & QStyle::State_Selected ? QPalette::Highlight : QPalette::Window);
+    style->drawPrimitive(QStyle::PE_FrameFocusRect, &focus, painter, option.widget);
+}
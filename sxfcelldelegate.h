@@ -0,0 +1,43 @@
+#ifndef SXFCELLDELEGATE_H
+#define SXFCELLDELEGATE_H
+
+#include <QStyledItemDelegate>
+#include <QStaticText>
+#include <QFont>
+#include <QPen>
+#include <array>
+
+/**
+ * @brief Paints sheet cells straight from SxfModel::RawCellRole.
+ *
+ * The mark glyphs and the ten digits are laid out once per font as QStaticText,
+ * so painting a cell does no text shaping and no heap allocation.
+ */
+class SxfCellDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit SxfCellDelegate(QObject* parent = nullptr);
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+private:
+    void prepareGlyphs(const QFont& font) const;
+    const QPen& textPen(const QStyleOptionViewItem& option) const;
+    void drawFocus(QPainter* painter, const QStyleOptionViewItem& option, const QStyle* style) const;
+    static int markSlot(quint16 mark);
+
+    mutable QFont m_font;
+    mutable bool m_glyphsReady = false;
+    mutable std::array<QStaticText, 10> m_digits;
+    mutable std::array<qreal, 10> m_digitWidths = {};
+    mutable std::array<QStaticText, 4> m_marks; // KeyFrame, Inbetween, Inbetween2, Stop
+    mutable std::array<qreal, 4> m_markWidths = {};
+    mutable qreal m_spaceWidth = 0;
+    mutable qreal m_textHeight = 0;
+    mutable QPen m_textPen;
+    mutable QPen m_selectedTextPen;
+};
+
+#endif // SXFCELLDELEGATE_H
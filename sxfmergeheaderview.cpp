@@ -37,14 +37,20 @@ void SxfMergeHeaderView::mousePressEvent(QMouseEvent* event)
 void SxfMergeHeaderView::calculateGroups()
 {
     m_groups.clear();
+    m_sectionGroup.clear();
+    m_sizePrefixDirty = true;
     const SxfModel* model = qobject_cast<const SxfModel*>(this->model());
     if (!model) return;
 
-    if (model->columnCount() > 0) {
-        m_groups["Frame"].append(0);
+    const int columnCount = model->columnCount();
+    m_sectionGroup.fill(-1, columnCount);
+    if (columnCount > 0) {
+        m_groups.append({ "Frame", 0, 0 });
+        m_sectionGroup[0] = 0;
     }
 
-    for (int i = 1; i < model->columnCount(); ++i) {
+    // Areas are contiguous, so each group is one range of sections
+    for (int i = 1; i < columnCount; ++i) {
         int area = model->getColumnArea(i);
         QString groupName;
 
@@ -58,8 +64,41 @@ void SxfMergeHeaderView::calculateGroups()
             continue;
         }
 
-        m_groups[groupName].append(i);
+        if (m_groups.isEmpty() || m_groups.last().name != groupName || m_groups.last().last != i - 1) {
+            m_groups.append({ groupName, i, i });
+        }
+        else {
+            m_groups.last().last = i;
+        }
+        m_sectionGroup[i] = m_groups.size() - 1;
+    }
+    // Group names change only here; column edits repaint just their sections
+    viewport()->update();
+}
+
+int SxfMergeHeaderView::groupOf(int logicalIndex) const
+{
+    if (logicalIndex < 0 || logicalIndex >= m_sectionGroup.size())
+        return -1;
+    return m_sectionGroup[logicalIndex];
+}
+
+int SxfMergeHeaderView::sizeBefore(int logicalIndex) const
+{
+    if (m_sizePrefixDirty || m_sizePrefix.size() != m_sectionGroup.size() + 1) {
+        m_sizePrefix.resize(m_sectionGroup.size() + 1);
+        m_sizePrefix[0] = 0;
+        for (int i = 0; i < m_sectionGroup.size(); ++i) {
+            m_sizePrefix[i + 1] = m_sizePrefix[i] + sectionSize(i);
+        }
+        m_sizePrefixDirty = false;
     }
+    return m_sizePrefix[logicalIndex];
+}
+
+int SxfMergeHeaderView::groupWidth(const Group& group) const
+{
+    return sizeBefore(group.last + 1) - sizeBefore(group.first);
 }
 
 QSize SxfMergeHeaderView::sectionSizeFromContents(int logicalIndex) const
@@ -96,37 +135,43 @@ void SxfMergeHeaderView::paintSection(QPainter* painter, const QRect& rect, int
 
         QRect topRect = rect;
         topRect.setBottom(rect.center().y());
-        QString currentGroupName;
-        for (auto it = m_groups.constBegin(); it != m_groups.constEnd(); ++it) {
-            if (it.value().contains(logicalIndex)) {
-                currentGroupName = it.key();
-                break;
-            }
-        }
-
-        if (currentGroupName.isEmpty()) return;
-
-        if (m_groups.value(currentGroupName).first() == logicalIndex) {
-            int groupWidth = 0;
-            const QList<int>& indices = m_groups.value(currentGroupName);
-            for (int index : indices) {
-                groupWidth += sectionSize(index);
-            }
-
-            opt.rect = topRect;
-            opt.rect.setWidth(groupWidth);
-            opt.text = currentGroupName;
-            opt.textAlignment = Qt::AlignCenter;
-            style()->drawControl(QStyle::CE_HeaderSection, &opt, painter);
-            style()->drawControl(QStyle::CE_HeaderLabel, &opt, painter);
-        }
+        const int groupId = groupOf(logicalIndex);
+        if (groupId < 0) return;
+
+        // Every section draws its own slice of the band, so repainting one
+        // section never blanks the band above it
+        const Group& group = m_groups[groupId];
+        opt.rect = topRect;
+        opt.rect.setLeft(rect.left() - (sizeBefore(logicalIndex) - sizeBefore(group.first)));
+        opt.rect.setWidth(groupWidth(group));
+        opt.text = group.name;
+        opt.textAlignment = Qt::AlignCenter;
+        painter->save();
+        painter->setClipRect(topRect, Qt::IntersectClip);
+        style()->drawControl(QStyle::CE_HeaderSection, &opt, painter);
+        style()->drawControl(QStyle::CE_HeaderLabel, &opt, painter);
+        painter->restore();
     }
 }
 
+/**
+ * @brief Invalidates only what a resize can change: the resized section's
+ * group band, which spans from the group's first section, and everything
+ * to the right of the section, which moved.
+ */
 void SxfMergeHeaderView::handleSectionResized(int logicalIndex, int oldSize, int newSize)
 {
-    Q_UNUSED(logicalIndex);
     Q_UNUSED(oldSize);
     Q_UNUSED(newSize);
-    this->viewport()->update();
+    m_sizePrefixDirty = true;
+
+    int left = sectionViewportPosition(logicalIndex);
+    const int groupId = groupOf(logicalIndex);
+    if (groupId >= 0) {
+        left = qMin(left, sectionViewportPosition(m_groups[groupId].first));
+    }
+    left = qMax(left, 0);
+    if (left >= viewport()->width())
+        return;
+    this->viewport()->update(QRect(left, 0, viewport()->width() - left, viewport()->height()));
 }
\ No newline at end of file
@@ -3,7 +3,7 @@
 
 #include <QHeaderView>
 #include <QPainter>
-#include <QMap>
+#include <QVector>
 
 // --- New Includes ---
 #include <QMouseEvent>
@@ -31,8 +31,22 @@ protected:
     void mousePressEvent(QMouseEvent* event) override;
 
 private:
-    // Grouping info: Key is group name ("ACTION" or "CELL"), Value is list of logical column indices.
-    QMap<QString, QList<int>> m_groups;
+    // A run of adjacent sections sharing one band ("Frame", "ACTION" or "CELL")
+    struct Group {
+        QString name;
+        int first;
+        int last;
+    };
+
+    int groupOf(int logicalIndex) const;
+    int sizeBefore(int logicalIndex) const;
+    int groupWidth(const Group& group) const;
+
+    QVector<Group> m_groups;
+    QVector<int> m_sectionGroup; // Group id per logical index, -1 for none
+    // m_sizePrefix[i] is the total size of sections before i, rebuilt after resizes
+    mutable QVector<int> m_sizePrefix;
+    mutable bool m_sizePrefixDirty = true;
 
 private slots:
     void handleSectionResized(int logicalIndex, int oldSize, int newSize);
@@ -19,10 +19,14 @@ namespace {
         {"●", 0x0004},
         {"×", 0x0008}
     };
+
+    // 每次 fetchMore 提供的行数
+    const int FETCH_CHUNK_ROWS = 1000;
 } // end anonymous namespace
 
 SxfModel::SxfModel(QObject* parent)
     : QAbstractTableModel(parent)
+    , m_document(QSharedPointer<SxfData>::create())
 {
 }
 
@@ -30,7 +34,27 @@ int SxfModel::rowCount(const QModelIndex& parent) const
 {
     if (parent.isValid())
         return 0;
-    return m_sxfData.property.maxFrames;
+    return m_fetchedRows;
+}
+
+bool SxfModel::canFetchMore(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return false;
+    return m_fetchedRows < int(m_document->property.maxFrames);
+}
+
+void SxfModel::fetchMore(const QModelIndex& parent)
+{
+    if (parent.isValid())
+        return;
+    const int rows = qMin(int(m_document->property.maxFrames) - m_fetchedRows, FETCH_CHUNK_ROWS);
+    if (rows <= 0)
+        return;
+
+    beginInsertRows(QModelIndex(), m_fetchedRows, m_fetchedRows + rows - 1);
+    m_fetchedRows += rows;
+    endInsertRows();
 }
 
 int SxfModel::columnCount(const QModelIndex& parent) const
@@ -38,8 +62,8 @@ int SxfModel::columnCount(const QModelIndex& parent) const
     if (parent.isValid())
         return 0;
 
-    int actionCols = m_sxfData.actionSheet.columns.length();
-    int cellCols = m_sxfData.cellSheet.columns.length();
+    int actionCols = m_document->actionSheet.columns().length();
+    int cellCols = m_document->cellSheet.columns().length();
 
     if (actionCols == 0 && cellCols == 0)
         return 0;
@@ -55,32 +79,32 @@ QVariant SxfModel::data(const QModelIndex& index, int role) const
     int row = index.row(); // This is the frame number (0-based)
     int col = index.column();
 
+    if (role == RawCellRole) {
+        // 不分配内存：quint64 直接存放在 QVariant 内
+        if (col == 0) {
+            return packCell({ 0, quint32(row + 1) });
+        }
+        const SxfColumn* column = columnAt(col);
+        if (column && row < column->cellCount()) {
+            return packCell(cellAt(col, row));
+        }
+        return packCell({ 0, 0 });
+    }
+
     if (role == Qt::DisplayRole) {
         if (col == 0) {
             // First column is frame number (1-based)
             return QString::number(row + 1);
         }
 
-        // Find the correct column
-        const SxfColumn* column = nullptr;
-        int actionSheetColCount = m_sxfData.actionSheet.columns.length();
-        int cellIdx = col - 1; // 0-based index of data columns
-
-        int columnArea = getColumnArea(col); // 0 = ACTION, 1 = CELL
-
-        if (columnArea == 0) { // ACTION
-            column = &(m_sxfData.actionSheet.columns[cellIdx]);
-        }
-        else if (columnArea == 1) { // CELL
-            cellIdx -= actionSheetColCount;
-            column = &(m_sxfData.cellSheet.columns[cellIdx]);
-        }
+        // Find the correct column (const access, shared lists stay shared)
+        const SxfColumn* column = columnAt(col);
 
         if (column) {
             // --- 修复点 (V6) ---
             // 这是一个 DENSE 列表。'row' 是 'cells' 列表的索引。
-            if (row < column->cells.length()) {
-                const SxfCell& cell = column->cells[row];
+            if (row < column->cellCount()) {
+                const SxfCell cell = cellAt(col, row);
                 quint16 mark = cell.mark;
                 quint32 frameId = cell.frameIndex; // "原画编号"
 
@@ -103,7 +127,7 @@ QVariant SxfModel::data(const QModelIndex& index, int role) const
             }
             // --- 结束修复 ---
         }
-        // 'row' 越界 (理论上不应发生，如果 loadData 正确填充)
+        // 'row' 超出该列：空单元格，保存时补齐
         return "";
     }
 
@@ -123,36 +147,17 @@ bool SxfModel::setData(const QModelIndex& index, const QVariant& value, int role
         return false;
     }
 
-    // Find the correct column
-    SxfColumn* column = nullptr;
-    int actionSheetColCount = m_sxfData.actionSheet.columns.length();
-    int cellIdx = col - 1; // 0-based index of data columns
-
-    int columnArea = getColumnArea(col); // 0 = ACTION, 1 = CELL
-
-    if (columnArea == 0) { // ACTION
-        column = &(m_sxfData.actionSheet.columns[cellIdx]);
-    }
-    else if (columnArea == 1) { // CELL
-        cellIdx -= actionSheetColCount;
-        column = &(m_sxfData.cellSheet.columns[cellIdx]);
-    }
-
-    if (!column) {
+    // Find the correct column (const access, nothing is decoded for editing yet)
+    if (!qAsConst(*this).columnAt(col)) {
         return false; // Column out of bounds
     }
 
     // --- 修复点 (V6) ---
 
-    // 1. 如果需要，扩展 'cells' 列表以适应新行
-    while (row >= column->cells.length()) {
-        column->cells.append(SxfCell());
-    }
-
-    // 2. 获取单元格的引用
-    SxfCell& cell = column->cells[row];
+    // 1. 获取单元格的副本 (列按 SoA 存储，没有 SxfCell 可引用)，超出该列的行为空
+    SxfCell cell = cellAt(col, row);
 
-    // 3. 解析输入值
+    // 2. 解析输入值
     QString strValue = value.toString().trimmed();
     quint16 newType = cell.mark; // 默认保留旧 type
     quint32 newFrameId = cell.frameIndex; // 默认保留旧 frameId
@@ -227,15 +232,25 @@ bool SxfModel::setData(const QModelIndex& index, const QVariant& value, int role
         }
     }
 
-    // 4. 应用更改
-    cell.mark = newType;
-    cell.frameIndex = newFrameId;
+    // 3. 应用更改：只有单元格真的改变时才取可编辑的列 (分页模式下该列会解码并常驻内存)
+    if (newType != cell.mark || newFrameId != cell.frameIndex) {
+        SxfColumn* column = editColumnAt(col);
+        if (row >= column->cellCount()) {
+            column->resizeCells(row + 1);
+        }
+        cell.mark = newType;
+        cell.frameIndex = newFrameId;
+        column->setCell(row, cell);
+    }
 
-    // 5. 更新总帧数 (如果需要)
-    if (row >= m_sxfData.property.maxFrames) {
-        m_sxfData.property.maxFrames = row + 1;
-        // 调用 loadData 以便填充所有其他列
-        loadData(m_sxfData);
+    // 4. 更新总帧数 (如果需要)
+    if (row >= m_document->property.maxFrames) {
+        // 只插入新增的行，其他列不在此填充：data() 把超出的行当作空单元格，
+        // 保存时由各列写出时补齐
+        beginInsertRows(QModelIndex(), m_fetchedRows, row);
+        m_document->property.maxFrames = row + 1;
+        m_fetchedRows = row + 1;
+        endInsertRows();
     }
     else {
         emit dataChanged(index, index, { Qt::DisplayRole, Qt::EditRole });
@@ -254,20 +269,8 @@ QVariant SxfModel::headerData(int section, Qt::Orientation orientation, int role
             return "Frame";
         }
 
-        // Find the correct column
-        const SxfColumn* column = nullptr;
-        int actionSheetColCount = m_sxfData.actionSheet.columns.length();
-        int cellIdx = section - 1; // 0-based index of data columns
-
-        int columnArea = getColumnArea(section); // 0 = ACTION, 1 = CELL
-
-        if (columnArea == 0) { // ACTION
-            column = &(m_sxfData.actionSheet.columns[cellIdx]);
-        }
-        else if (columnArea == 1) { // CELL
-            cellIdx -= actionSheetColCount;
-            column = &(m_sxfData.cellSheet.columns[cellIdx]);
-        }
+        // Find the correct column (const access, shared lists stay shared)
+        const SxfColumn* column = columnAt(section);
 
         if (column) {
             return column->name;
@@ -293,34 +296,157 @@ Qt::ItemFlags SxfModel::flags(const QModelIndex& index) const
     return QAbstractTableModel::flags(index) | Qt::ItemIsEditable;
 }
 
-void SxfModel::loadData(const SxfData& data)
+void SxfModel::setDocument(const QSharedPointer<SxfData>& document)
 {
+    // 不再预先填充各列：data() 把缺少的单元格当作空，保存时写出补齐
     beginResetModel();
-    m_sxfData = data;
+    m_document = document;
+    m_fetchedRows = qMin(int(m_document->property.maxFrames), FETCH_CHUNK_ROWS);
+    endResetModel();
+}
 
-    // --- 修复点 (V6) ---
-    // 确保所有 'cells' 列表都填充到 'maxFrames'
-    // 这样模型才是 DENSE 的，而不是 SPARSE 的
-    quint32 maxFrames = m_sxfData.property.maxFrames;
+QSharedPointer<SxfData> SxfModel::document() const
+{
+    return m_document;
+}
 
-    for (SxfColumn& col : m_sxfData.actionSheet.columns) {
-        while (col.cells.length() < maxFrames) {
-            col.cells.append(SxfCell()); // SxfCell() 默认为 {0, 0}
-        }
+/**
+ * @brief 修改总帧数，只通知已提供给视图的行的变化
+ * 缩短时保留超出的单元格，重新加长时不会丢失；保存时各列截断或补齐到 maxFrames
+ */
+void SxfModel::setMaxFrames(int maxFrames)
+{
+    const int oldMaxFrames = m_document->property.maxFrames;
+    if (maxFrames == oldMaxFrames)
+        return;
+
+    if (maxFrames > oldMaxFrames && m_fetchedRows == oldMaxFrames) {
+        // 所有行都已提供，新行直接插入
+        beginInsertRows(QModelIndex(), oldMaxFrames, maxFrames - 1);
+        m_document->property.maxFrames = maxFrames;
+        m_fetchedRows = maxFrames;
+        endInsertRows();
     }
-    for (SxfColumn& col : m_sxfData.cellSheet.columns) {
-        while (col.cells.length() < maxFrames) {
-            col.cells.append(SxfCell());
-        }
+    else if (maxFrames < m_fetchedRows) {
+        beginRemoveRows(QModelIndex(), maxFrames, m_fetchedRows - 1);
+        m_document->property.maxFrames = maxFrames;
+        m_fetchedRows = maxFrames;
+        endRemoveRows();
     }
-    // --- 结束修复 ---
+    else {
+        // 变化都在未提供的部分，留给 fetchMore
+        m_document->property.maxFrames = maxFrames;
+    }
+}
 
-    endResetModel();
+bool SxfModel::setColumnName(int column, const QString& name)
+{
+    SxfColumn* sxfColumn = columnAt(column);
+    if (!sxfColumn)
+        return false;
+    if (sxfColumn->name != name) {
+        sxfColumn->name = name;
+        emit headerDataChanged(Qt::Horizontal, column, column);
+    }
+    return true;
+}
+
+bool SxfModel::setColumnVisible(int column, bool visible)
+{
+    SxfColumn* sxfColumn = columnAt(column);
+    if (!sxfColumn)
+        return false;
+    // 表头不显示可见性，不发出 headerDataChanged
+    sxfColumn->isVisible = visible ? 1 : 0;
+    return true;
+}
+
+bool SxfModel::setColumnResv(int column, quint32 resv)
+{
+    SxfColumn* sxfColumn = columnAt(column);
+    if (!sxfColumn)
+        return false;
+    // 表头不显示 resv，不发出 headerDataChanged
+    sxfColumn->resv = resv;
+    return true;
+}
+
+/**
+ * @brief mark 对应的显示符号
+ * @return 未知 mark 返回空字符串
+ */
+QString SxfModel::markSymbol(quint16 mark)
+{
+    return cellTypeToStrMap.value(mark, "");
+}
+
+/**
+ * @brief 按模型列号取文档中的列
+ * @return 0 (Frame) 或越界时返回 nullptr
+ */
+const SxfColumn* SxfModel::columnAt(int column) const
+{
+    // 只读访问，避免与保存快照共享的列表被 detach
+    const SxfData& document = *m_document;
+    int columnArea = getColumnArea(column);
+    int cellIdx = column - 1;
+    if (columnArea == 0) {
+        return &document.actionSheet.columns().at(cellIdx);
+    }
+    if (columnArea == 1) {
+        cellIdx -= document.actionSheet.columns().length();
+        return &document.cellSheet.columns().at(cellIdx);
+    }
+    return nullptr;
+}
+
+/**
+ * @brief 读取单元格，分页模式下通过列缓存解码
+ */
+SxfCell SxfModel::cellAt(int column, int row) const
+{
+    const SxfData& document = *m_document;
+    int columnArea = getColumnArea(column);
+    int cellIdx = column - 1;
+    if (columnArea == 0) {
+        return document.actionSheet.cell(cellIdx, row);
+    }
+    if (columnArea == 1) {
+        cellIdx -= document.actionSheet.columns().length();
+        return document.cellSheet.cell(cellIdx, row);
+    }
+    return { 0, 0 };
 }
 
-SxfData SxfModel::getData() const
+/**
+ * @brief 取得可编辑的列，分页模式下该列被解码并常驻内存
+ */
+SxfColumn* SxfModel::editColumnAt(int column)
 {
-    return m_sxfData;
+    int columnArea = getColumnArea(column);
+    int cellIdx = column - 1;
+    if (columnArea == 0) {
+        return &m_document->actionSheet.editColumn(cellIdx);
+    }
+    if (columnArea == 1) {
+        cellIdx -= m_document->actionSheet.columns().length();
+        return &m_document->cellSheet.editColumn(cellIdx);
+    }
+    return nullptr;
+}
+
+SxfColumn* SxfModel::columnAt(int column)
+{
+    int columnArea = getColumnArea(column);
+    int cellIdx = column - 1;
+    if (columnArea == 0) {
+        return &m_document->actionSheet.columns()[cellIdx];
+    }
+    if (columnArea == 1) {
+        cellIdx -= m_document->actionSheet.columns().length();
+        return &m_document->cellSheet.columns()[cellIdx];
+    }
+    return nullptr;
 }
 
 // ============== 改造部分：新增 getColumnArea 函数 ==============
@@ -337,7 +463,7 @@ int SxfModel::getColumnArea(int column) const
         return -1;
     }
 
-    int actionSheetColCount = m_sxfData.actionSheet.columns.length();
+    int actionSheetColCount = m_document->actionSheet.columns().length();
     int cellIdx = column - 1; // 0-based index of data columns
 
     if (cellIdx < actionSheetColCount) {
@@ -345,7 +471,7 @@ int SxfModel::getColumnArea(int column) const
     }
 
     cellIdx -= actionSheetColCount;
-    if (cellIdx < m_sxfData.cellSheet.columns.length()) {
+    if (cellIdx < m_document->cellSheet.columns().length()) {
         return 1; // CELL
     }
 
@@ -9,6 +9,12 @@ class SxfModel : public QAbstractTableModel
     Q_OBJECT
 
 public:
+    // RawCellRole: 单元格打包成 quint64，高 32 位为 mark，低 32 位为 frameIndex，
+    // 供 SxfCellDelegate 直接绘制，不产生 QString。Frame 列返回 mark 0 和帧号。
+    enum Roles {
+        RawCellRole = Qt::UserRole + 1
+    };
+
     explicit SxfModel(QObject* parent = nullptr);
 
     // QAbstractTableModel 接口
@@ -19,14 +25,37 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
     Qt::ItemFlags flags(const QModelIndex& index) const override;
 
-    // 数据操作
-    void loadData(const SxfData& data);
-    SxfData getData() const;
+    // 行按块提供给视图，长表先只显示第一块
+    bool canFetchMore(const QModelIndex& parent) const override;
+    void fetchMore(const QModelIndex& parent) override;
+
+    // 数据操作：模型与 SxfViewer 共享同一份文档，不再复制
+    void setDocument(const QSharedPointer<SxfData>& document);
+    QSharedPointer<SxfData> document() const;
+    void setMaxFrames(int maxFrames);
+
+    // 列属性修改：只有表头显示的列名会对该列发出 headerDataChanged
+    bool setColumnName(int column, const QString& name);
+    bool setColumnVisible(int column, bool visible);
+    bool setColumnResv(int column, quint32 resv);
 
     int getColumnArea(int column) const;
 
+    // mark 对应的显示符号，未知 mark 返回空字符串
+    static QString markSymbol(quint16 mark);
+
+    static quint64 packCell(const SxfCell& cell) { return (quint64(cell.mark) << 32) | cell.frameIndex; }
+    static SxfCell unpackCell(quint64 packed) { return { quint16(packed >> 32), quint32(packed) }; }
+
 private:
-    SxfData m_sxfData;
+    // columnAt() 只用于列头属性；分页模式下单元格要经 cellAt()/editColumnAt()
+    SxfColumn* columnAt(int column);
+    const SxfColumn* columnAt(int column) const;
+    SxfCell cellAt(int column, int row) const;
+    SxfColumn* editColumnAt(int column);
+
+    QSharedPointer<SxfData> m_document;
+    int m_fetchedRows = 0; // 已提供给视图的行数，不超过 maxFrames
 };
 
 #endif // SXFMODEL_H
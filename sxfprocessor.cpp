@@ -1,5 +1,8 @@
 #include "sxfprocessor.h"
+#include "sxfcellcodec.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
 #include <QTextStream>
 #include <QRegularExpression>
 #include <QUrl>
@@ -7,7 +10,16 @@
 #include <QTextCodec>
 #include <QByteArray>
 #include <QDataStream>
+#include <QMutex>
+#include <QtConcurrent>
+#include <QVarLengthArray>
 #include <stdexcept> 
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <numeric>
 
 namespace {
 	const quint8 BLOCK_START_CODE = 0xFF;
@@ -19,9 +31,15 @@ namespace {
 		return (total - currentPos) >= requiredSize;
 	}
 
-	void writeBlockHeader(QDataStream& stream, quint8 blockId) {
-		stream << BLOCK_START_CODE;
-		stream << blockId;
+	// Start code + block ID + 32-bit size prefix
+	const qint64 BLOCK_HEADER_SIZE = 6;
+
+	// Below this many columns a sheet is decoded on the calling thread
+	const int PARALLEL_DECODE_MIN_COLUMNS = 8;
+
+	void writeBlockHeader(SxfByteWriter& writer, quint8 blockId) {
+		writer.writeU8(BLOCK_START_CODE);
+		writer.writeU8(blockId);
 	}
 
 	quint8 readblockHeaderThrow(QDataStream& stream) {
@@ -48,6 +66,69 @@ namespace {
 		return blockId;
 	}
 
+	quint8 readblockHeaderThrow(SxfByteReader& reader) {
+		if (reader.atEnd()) {
+			throw std::runtime_error("Parsing error: Stream ended before reading block start code (0xFF).");
+		}
+
+		quint8 startCode = reader.readU8();
+
+		if (startCode != BLOCK_START_CODE) {
+			QString errorMsg = QString("Parsing error: Expected start code 0xFF, but found 0x%1.")
+				.arg(startCode, 2, 16, QChar('0')).toUpper();
+			throw std::runtime_error(errorMsg.toStdString());
+		}
+
+		if (reader.atEnd()) {
+			throw std::runtime_error("Parsing error: Stream ended after start code 0xFF. Block ID missing.");
+		}
+
+		return reader.readU8();
+	}
+
+	const quint32 EXPECTED_MAGIC_VALUE = 0x57425343;//WBSC
+	const quint32 EXPECTED_VERSION_VALUE = 0x01000007;
+
+	void checkMagicNumber(quint32 magicNumValue, qint64 fileSize) {
+		if (magicNumValue != EXPECTED_MAGIC_VALUE) {
+			QString errorMsg = QString("File too short to contain Magic Number. Size: %1 bytes.")
+				.arg(fileSize);
+			throw std::runtime_error(errorMsg.toStdString());
+		}
+	}
+
+	QString decodeNoteContent(const char* bytes, int size) {
+		bool chinese = true;
+		bool japanese = false;
+		if (chinese) {
+			QTextCodec* gbkCodec = QTextCodec::codecForName("GBK");
+			return gbkCodec->toUnicode(bytes, size);
+		}
+		else if (japanese) {
+			QTextCodec* shiftJisCodec = QTextCodec::codecForName("Shift-JIS");
+			return shiftJisCodec->toUnicode(bytes, size);
+		}
+		else {
+			return QString::fromUtf8(bytes, size);
+		}
+	}
+
+	QByteArray encodeNoteContent(const QString& content) {
+		bool chinese = true;
+		bool japanese = false;
+		if (chinese) {
+			QTextCodec* gbkCodec = QTextCodec::codecForName("GBK");
+			return gbkCodec->fromUnicode(content);
+		}
+		else if (japanese) {
+			QTextCodec* shiftJisCodec = QTextCodec::codecForName("Shift-JIS");
+			return shiftJisCodec->fromUnicode(content);
+		}
+		else {
+			return content.toUtf8();
+		}
+	}
+
 	const QMap<quint16, QString> cellTypeToStrMap = {
 	{0x0001, "#"},
 	{0x0002, "○"},
@@ -61,6 +142,89 @@ namespace {
 	{"●", 0x0004},
 	{"×", 0x0008}
 	};
+
+	// Big-endian encoding of one field type, std::array fields are stored element by element
+	template <typename T>
+	struct SxfFieldCodec {
+		static constexpr qint64 size = sizeof(T);
+		static void read(T& value, const uchar* src) { value = qFromBigEndian<T>(src); }
+		static void write(const T& value, uchar* dst) { qToBigEndian<T>(value, dst); }
+	};
+
+	template <typename T, std::size_t N>
+	struct SxfFieldCodec<std::array<T, N>> {
+		static constexpr qint64 size = qint64(sizeof(T) * N);
+		static void read(std::array<T, N>& values, const uchar* src) { qFromBigEndian<T>(src, N, values.data()); }
+		static void write(const std::array<T, N>& values, uchar* dst) { qToBigEndian<T>(values.data(), N, dst); }
+	};
+
+	// One member of a fixed-layout block, e.g. SxfField<&SxfProperty::fps>
+	template <auto Member>
+	struct SxfField;
+
+	template <typename Block, typename T, T Block::*Member>
+	struct SxfField<Member> {
+		static constexpr qint64 size = SxfFieldCodec<T>::size;
+		static void read(Block& block, const uchar* src) { SxfFieldCodec<T>::read(block.*Member, src); }
+		static void write(const Block& block, uchar* dst) { SxfFieldCodec<T>::write(block.*Member, dst); }
+	};
+
+	// The fields of a fixed-layout block in file order. Every offset and width is
+	// known at compile time, so read() and write() reduce to loads, byte swaps and
+	// stores over one contiguous span of the payload.
+	template <typename Block, typename... Fields>
+	struct SxfLayout {
+		static constexpr qint64 size = (Fields::size + ...);
+
+		static void read(Block& block, const uchar* src) {
+			((Fields::read(block, src), src += Fields::size), ...);
+		}
+		static void write(const Block& block, uchar* dst) {
+			((Fields::write(block, dst), dst += Fields::size), ...);
+		}
+		static void read(Block& block, SxfByteReader& reader) {
+			read(block, reader.readBytes(size));
+		}
+		static void read(Block& block, QDataStream& stream) {
+			// Missing bytes decode as zeros, like QDataStream's operators past the end
+			uchar bytes[size] = {};
+			stream.readRawData(reinterpret_cast<char*>(bytes), int(size));
+			read(block, bytes);
+		}
+		static void write(const Block& block, SxfByteWriter& writer) {
+			write(block, writer.claim(size));
+		}
+	};
+
+	using SxfPropertyLayout = SxfLayout<SxfProperty,
+		SxfField<&SxfProperty::resv1>,
+		SxfField<&SxfProperty::maxFrames>,
+		SxfField<&SxfProperty::layerCount>,
+		SxfField<&SxfProperty::fps>,
+		SxfField<&SxfProperty::sceneNumber>,
+		SxfField<&SxfProperty::resv2>,
+		SxfField<&SxfProperty::cutNumber>,
+		SxfField<&SxfProperty::resv3>,
+		SxfField<&SxfProperty::timeFormat>,
+		SxfField<&SxfProperty::rulerInterval>,
+		SxfField<&SxfProperty::framePerPage>,
+		SxfField<&SxfProperty::widgets>,
+		SxfField<&SxfProperty::visibilities>>;
+	static_assert(SxfPropertyLayout::size == SxfProperty::getSize(), "SxfProperty layout does not match getSize()");
+
+	// Only the leading field, the per-frame data that follows is reserved
+	using SxfSoundLayout = SxfLayout<SxfSound,
+		SxfField<&SxfSound::resv1>>;
+	static_assert(SxfSoundLayout::size == SxfSound::getSize(0), "SxfSound layout does not match getSize(0)");
+
+	using SxfDialogueLayout = SxfLayout<SxfDialogue,
+		SxfField<&SxfDialogue::resv1>>;
+	static_assert(SxfDialogueLayout::size == SxfDialogue::getSize(), "SxfDialogue layout does not match getSize()");
+
+	using SxfDrawLayout = SxfLayout<SxfDraw,
+		SxfField<&SxfDraw::resv1>,
+		SxfField<&SxfDraw::resv2>>;
+	static_assert(SxfDrawLayout::size == SxfDraw::getSize(), "SxfDraw layout does not match getSize()");
 }
 
 void SxfProperty::read(QDataStream& stream)
@@ -70,50 +234,29 @@ void SxfProperty::read(QDataStream& stream)
 	if (size < getSize())
 		throw std::runtime_error("SxfProperty block size is smaller than expected.");
 
-	stream >> resv1;
-	stream >> maxFrames;
-	stream >> layerCount;
-	stream >> fps;
-	stream >> sceneNumber;
-	stream >> resv2;
-	stream >> cutNumber;
-	for (quint32& val : resv3) {
-		stream >> val;
-	}
-	stream >> timeFormat;
-	stream >> rulerInterval;
-	stream >> framePerPage;
-	for (quint16& widget : widgets) {
-		stream >> widget;
-	}
-	for (quint32& visibility : visibilities) {
-		stream >> visibility;
-	}
+	SxfPropertyLayout::read(*this, stream);
 }
 
-void SxfProperty::write(QDataStream& stream)
+void SxfProperty::read(SxfByteReader& reader)
 {
-	writeBlockHeader(stream, 0x01);
-	stream << getSize();
-	stream << resv1;
-	stream << maxFrames;
-	stream << layerCount;
-	stream << fps;
-	stream << sceneNumber;
-	stream << resv2;
-	stream << cutNumber;
-	for (const quint32& val : resv3) {
-		stream << val;
-	}
-	stream << timeFormat;
-	stream << rulerInterval;
-	stream << framePerPage;
-	for (const quint16& widget : widgets) {
-		stream << widget;
-	}
-	for (const quint32& visibility : visibilities) {
-		stream << visibility;
-	}
+	quint32 size = reader.readU32();
+	if (size < getSize())
+		throw std::runtime_error("SxfProperty block size is smaller than expected.");
+
+	SxfPropertyLayout::read(*this, reader);
+}
+
+void SxfProperty::write(SxfByteWriter& writer)
+{
+	writeBlockHeader(writer, 0x01);
+	writer.writeU32(getSize());
+	SxfPropertyLayout::write(*this, writer);
+}
+
+const quint32 SxfNote::getSize()
+{
+	quint16 contentSize = static_cast<quint16>(encodeNoteContent(content).size());
+	return 2 + contentSize + 4;
 }
 
 void SxfNote::read(QDataStream& stream)
@@ -128,78 +271,35 @@ void SxfNote::read(QDataStream& stream)
 	QByteArray contentBytes;
 	contentBytes.resize(contentSize);
 	stream.readRawData(contentBytes.data(), contentSize);
-
-	bool chinese = true;
-	bool japanese = false;
-	if (chinese) {
-		QTextCodec* gbkCodec = QTextCodec::codecForName("GBK");
-		content = gbkCodec->toUnicode(contentBytes);
-	}
-	else if (japanese) {
-		QTextCodec* shiftJisCodec = QTextCodec::codecForName("Shift-JIS");
-		content = shiftJisCodec->toUnicode(contentBytes);
-	}
-	else {
-		content = QString::fromUtf8(contentBytes);
-	}
+	content = decodeNoteContent(contentBytes.constData(), contentBytes.size());
 
 	stream >> bigFont;
 }
 
-void SxfNote::write(QDataStream& stream)
-{
-	writeBlockHeader(stream, 0x02);
-	stream << getSize();
-
-	bool chinese = true;
-	bool japanese = false;
-
-	QByteArray contentBytes;
-	if (chinese) {
-		QTextCodec* gbkCodec = QTextCodec::codecForName("GBK");
-		contentBytes = gbkCodec->fromUnicode(content);
-	}
-	else if (japanese) {
-		QTextCodec* shiftJisCodec = QTextCodec::codecForName("Shift-JIS");
-		contentBytes = shiftJisCodec->fromUnicode(content);
-	}
-	else {
-		contentBytes = content.toUtf8();
-	}
-
-	quint16 contentSize = static_cast<quint16>(contentBytes.size());
-	stream << contentSize;
-	stream.writeRawData(contentBytes.constData(), contentSize);
-
-	stream << bigFont;
-}
-
-void SxfCell::read(QDataStream& stream)
+void SxfNote::read(SxfByteReader& reader)
 {
-	stream >> mark;
-	if (stream.status() != QDataStream::Ok) return;
+	quint32 size = reader.readU32();
+	if (size < getSize())
+		throw std::runtime_error("SxfNote block size is smaller than expected.");
 
-	char buffer[8];
-	stream.readRawData(buffer, 8);
+	quint16 contentSize = reader.readU16();
+	const uchar* contentBytes = reader.readBytes(contentSize);
+	content = decodeNoteContent(reinterpret_cast<const char*>(contentBytes), contentSize);
 
-	QByteArray asciiData(buffer, 8);
-	frameIndex = asciiData.toUInt();
+	bigFont = reader.readU32();
 }
 
-void SxfCell::write(QDataStream& stream)
+void SxfNote::write(SxfByteWriter& writer)
 {
-	stream << mark;
-
-	QByteArray buffer(8, 0x00);
-	if (frameIndex > 0) {
-		QString frameIndexStr = QString::number(frameIndex);
-		QByteArray asciiData = frameIndexStr.toLocal8Bit();
+	writeBlockHeader(writer, 0x02);
 
-		int bytesToWrite = qMin(asciiData.length(), 8);
-		memcpy(buffer.data(), asciiData.constData(), bytesToWrite);
-	}
+	QByteArray contentBytes = encodeNoteContent(content);
+	quint16 contentSize = static_cast<quint16>(contentBytes.size());
+	writer.writeU32(2 + contentSize + 4);
+	writer.writeU16(contentSize);
+	writer.writeBytes(contentBytes.constData(), contentSize);
 
-	stream.writeRawData(buffer.constData(), 8);
+	writer.writeU32(bigFont);
 }
 
 void SxfColumn::read(QDataStream& stream)
@@ -219,37 +319,300 @@ void SxfColumn::read(QDataStream& stream)
 	stream >> isVisible;
 	stream >> resv;
 
-	cells.clear();
 	quint32 cellsSize = size - (2 + nameSize + 8);
-	if (cellsSize % 10 != 0) {
+	if (cellsSize % SXF_CELL_SIZE != 0) {
 		throw std::runtime_error("Invalid cells size: not divisible by cell record size.");
 	}
 
-	quint32 cellCount = cellsSize / 10;
-	cells.reserve(cellCount);
+	// Short reads leave zeros behind, which decode as empty cells
+	QByteArray cellBytes(static_cast<int>(cellsSize), '\0');
+	stream.readRawData(cellBytes.data(), cellBytes.size());
+	decodeCells(reinterpret_cast<const uchar*>(cellBytes.constData()), cellsSize / SXF_CELL_SIZE);
+	m_sourceOffset = -1;
+}
+
+quint32 SxfColumn::readHeader(SxfByteReader& reader)
+{
+	const qint64 sizeOffset = reader.pos();
+	quint32 size = reader.readU32();
+	if (size < getSize())
+		throw std::runtime_error("SxfColumn block size is smaller than expected.");
 
-	for (quint32 i = 0; i < cellCount; ++i) {
-		SxfCell cell;
-		cell.read(stream);
-		cells.append(cell);
+	quint16 nameSize = reader.readU16();
+	if (size < quint32(2 + nameSize + 8))
+		throw std::runtime_error("SxfColumn block size is smaller than its header.");
+	const uchar* nameBytes = reader.readBytes(nameSize);
+	name = QString::fromUtf8(reinterpret_cast<const char*>(nameBytes), nameSize);
+
+	isVisible = reader.readU32();
+	resv = reader.readU32();
+
+	quint32 cellsSize = size - (2 + nameSize + 8);
+	if (cellsSize % SXF_CELL_SIZE != 0) {
+		throw std::runtime_error("Invalid cells size: not divisible by cell record size.");
 	}
+
+	m_sourceOffset = sizeOffset;
+	m_sourceSize = size;
+	return cellsSize;
+}
+
+void SxfColumn::read(SxfByteReader& reader, const QSharedPointer<SxfArena>& arena)
+{
+	const quint32 cellsSize = readHeader(reader);
+	const uchar* cellBytes = reader.readBytes(cellsSize);
+	decodeCells(cellBytes, cellsSize / SXF_CELL_SIZE, arena);
+	m_cellsDirty = false;
+	m_stub = false;
+}
+
+void SxfColumn::readStub(SxfByteReader& reader)
+{
+	const quint32 cellsSize = readHeader(reader);
+	reader.skip(cellsSize);
+	resizeCells(0);
+	m_cellCount = int(cellsSize / SXF_CELL_SIZE);
+	m_cellsDirty = false;
+	m_stub = true;
+}
+
+bool SxfColumn::isUnchangedSince(const SxfSource& source) const
+{
+	if (m_sourceOffset < 0 || m_cellsDirty)
+		return false;
+
+	SxfByteReader reader(source.data(), source.size());
+	reader.seek(m_sourceOffset + 4);
+	const quint16 nameSize = reader.readU16();
+	const QByteArray nameBytes = name.toUtf8();
+	return nameBytes.size() == nameSize
+		&& memcmp(reader.readBytes(nameSize), nameBytes.constData(), nameSize) == 0
+		&& reader.readU32() == isVisible
+		&& reader.readU32() == resv;
 }
 
-void SxfColumn::write(QDataStream& stream)
+void SxfColumn::write(SxfByteWriter& writer, bool trimEmptyTail, int maxCells, const SxfSource* source) const
 {
-	stream << getSize();
+	if (canCopyVerbatim(source, trimEmptyTail, maxCells)) {
+		writer.writeBytes(source->data() + m_sourceOffset, 4 + qint64(m_sourceSize));
+		return;
+	}
+
+	writer.writeU32(getSize(trimEmptyTail, maxCells));
 	QByteArray nameBytes = name.toUtf8();
 
 	quint16 nameSize = static_cast<quint16>(nameBytes.size());
-	stream << nameSize;
-	stream.writeRawData(nameBytes.constData(), nameSize);
+	writer.writeU16(nameSize);
+	writer.writeBytes(nameBytes.constData(), nameSize);
+
+	writer.writeU32(isVisible);
+	writer.writeU32(resv);
+
+	// Cells are encoded straight into the output buffer
+	const int savedCells = savedCellCount(trimEmptyTail, maxCells);
+	encodeCells(writer.claim(qint64(savedCells) * SXF_CELL_SIZE), savedCells);
+}
+
+void SxfColumn::setCell(int row, const SxfCell& cell)
+{
+	int run = runAt(row);
+	const quint16 runMark = m_marks[run];
+	const quint32 runFrameIndex = m_frameIndices[run];
+	if (runMark == cell.mark && runFrameIndex == cell.frameIndex)
+		return;
+	m_cellsDirty = true;
+	detachRuns();
+
+	// Split the run so that row gets a run of its own
+	const quint32 runStart = run > 0 ? m_ownedRunEnds[run - 1] : 0;
+	const quint32 runEnd = m_ownedRunEnds[run];
+	if (quint32(row) + 1 < runEnd) {
+		m_ownedRunEnds.insert(run + 1, runEnd);
+		m_ownedMarks.insert(run + 1, runMark);
+		m_ownedFrameIndices.insert(run + 1, runFrameIndex);
+		m_ownedRunEnds[run] = row + 1;
+	}
+	if (quint32(row) > runStart) {
+		m_ownedRunEnds.insert(run, quint32(row));
+		m_ownedMarks.insert(run, runMark);
+		m_ownedFrameIndices.insert(run, runFrameIndex);
+		++run;
+	}
+	m_ownedMarks[run] = cell.mark;
+	m_ownedFrameIndices[run] = cell.frameIndex;
+
+	// Merge with equal neighbours
+	if (run + 1 < m_ownedRunEnds.size() && m_ownedMarks[run + 1] == cell.mark && m_ownedFrameIndices[run + 1] == cell.frameIndex) {
+		m_ownedRunEnds[run] = m_ownedRunEnds[run + 1];
+		removeRun(run + 1);
+	}
+	if (run > 0 && m_ownedMarks[run - 1] == cell.mark && m_ownedFrameIndices[run - 1] == cell.frameIndex) {
+		m_ownedRunEnds[run - 1] = m_ownedRunEnds[run];
+		removeRun(run);
+	}
+	syncRuns();
+}
+
+void SxfColumn::resizeCells(int count)
+{
+	if (count != m_cellCount) {
+		m_cellsDirty = true;
+	}
+	if (count >= m_cellCount) {
+		appendRun(CellMark::None, 0, count - m_cellCount);
+		return;
+	}
 
-	stream << isVisible;
-	stream << resv;
+	const int lastRun = count > 0 ? runAt(count - 1) : -1;
+	detachRuns();
+	m_ownedRunEnds.resize(lastRun + 1);
+	m_ownedMarks.resize(lastRun + 1);
+	m_ownedFrameIndices.resize(lastRun + 1);
+	if (lastRun >= 0) {
+		m_ownedRunEnds[lastRun] = count;
+	}
+	m_cellCount = count;
+	syncRuns();
+}
 
-	for (SxfCell& cell : cells) {
-		cell.write(stream);
+int SxfColumn::usedCellCount() const
+{
+	const int lastRun = runCount() - 1;
+	if (lastRun >= 0 && m_marks[lastRun] == CellMark::None && m_frameIndices[lastRun] == 0) {
+		return lastRun > 0 ? m_runEnds[lastRun - 1] : 0;
 	}
+	return m_cellCount;
+}
+
+void SxfColumn::decodeCells(const uchar* src, quint32 count, const QSharedPointer<SxfArena>& arena)
+{
+	m_cellsDirty = true;
+
+	// Identical records decode to identical cells, so the byte-wise runs bound
+	// the decoded runs and the run arrays are allocated once
+	int maxRuns = count > 0 ? 1 : 0;
+	for (quint32 i = 1; i < count; ++i) {
+		if (memcmp(src + i * SXF_CELL_SIZE, src + (i - 1) * SXF_CELL_SIZE, SXF_CELL_SIZE) != 0)
+			++maxRuns;
+	}
+
+	quint32* runEnds;
+	quint16* marks;
+	quint32* frameIndices;
+	if (arena && maxRuns > 0) {
+		// One block for all three arrays, widest elements first to keep them aligned
+		uchar* memory = static_cast<uchar*>(arena->allocate(qint64(maxRuns) * (2 * sizeof(quint32) + sizeof(quint16))));
+		runEnds = reinterpret_cast<quint32*>(memory);
+		frameIndices = runEnds + maxRuns;
+		marks = reinterpret_cast<quint16*>(frameIndices + maxRuns);
+		m_arena = arena;
+		m_ownedRunEnds.clear();
+		m_ownedMarks.clear();
+		m_ownedFrameIndices.clear();
+	}
+	else {
+		m_arena.clear();
+		m_ownedRunEnds = QVector<quint32>(maxRuns);
+		m_ownedMarks = QVector<quint16>(maxRuns);
+		m_ownedFrameIndices = QVector<quint32>(maxRuns);
+		runEnds = m_ownedRunEnds.data();
+		marks = m_ownedMarks.data();
+		frameIndices = m_ownedFrameIndices.data();
+	}
+
+	// Decode in stack-sized batches and fold each batch into runs
+	const quint32 BATCH_SIZE = 512;
+	quint16 batchMarks[BATCH_SIZE];
+	quint32 batchFrameIndices[BATCH_SIZE];
+	int runs = 0;
+	for (quint32 done = 0; done < count; ) {
+		const quint32 batch = qMin(BATCH_SIZE, count - done);
+		decodeSxfCells(src + done * SXF_CELL_SIZE, batch, batchMarks, batchFrameIndices);
+		for (quint32 i = 0; i < batch; ++i) {
+			if (runs > 0 && marks[runs - 1] == batchMarks[i] && frameIndices[runs - 1] == batchFrameIndices[i]) {
+				++runEnds[runs - 1];
+			}
+			else {
+				runEnds[runs] = done + i + 1;
+				marks[runs] = batchMarks[i];
+				frameIndices[runs] = batchFrameIndices[i];
+				++runs;
+			}
+		}
+		done += batch;
+	}
+	m_cellCount = int(count);
+
+	if (m_arena) {
+		m_runEnds = runEnds;
+		m_marks = marks;
+		m_frameIndices = frameIndices;
+		m_runCount = runs;
+	}
+	else {
+		m_ownedRunEnds.resize(runs);
+		m_ownedMarks.resize(runs);
+		m_ownedFrameIndices.resize(runs);
+		syncRuns();
+	}
+}
+
+void SxfColumn::encodeCells(uchar* dst, quint32 count) const
+{
+	quint32 runStart = 0;
+	for (int run = 0; run < runCount() && runStart < count; ++run) {
+		const quint32 runEnd = qMin(m_runEnds[run], count);
+		encodeSxfCellRun(m_marks[run], m_frameIndices[run], runEnd - runStart, dst + runStart * SXF_CELL_SIZE);
+		runStart = runEnd;
+	}
+	if (runStart < count)
+		encodeSxfCellRun(CellMark::None, 0, count - runStart, dst + runStart * SXF_CELL_SIZE);
+}
+
+void SxfColumn::appendRun(quint16 mark, quint32 frameIndex, quint32 length)
+{
+	if (length == 0)
+		return;
+
+	detachRuns();
+	const int lastRun = m_ownedRunEnds.size() - 1;
+	if (lastRun >= 0 && m_ownedMarks[lastRun] == mark && m_ownedFrameIndices[lastRun] == frameIndex) {
+		m_ownedRunEnds[lastRun] += length;
+	}
+	else {
+		m_ownedRunEnds.append(m_cellCount + length);
+		m_ownedMarks.append(mark);
+		m_ownedFrameIndices.append(frameIndex);
+	}
+	m_cellCount += length;
+	syncRuns();
+}
+
+void SxfColumn::removeRun(int run)
+{
+	m_ownedRunEnds.remove(run);
+	m_ownedMarks.remove(run);
+	m_ownedFrameIndices.remove(run);
+}
+
+void SxfColumn::detachRuns()
+{
+	if (!m_arena)
+		return;
+
+	m_ownedRunEnds = QVector<quint32>(m_runEnds, m_runEnds + m_runCount);
+	m_ownedMarks = QVector<quint16>(m_marks, m_marks + m_runCount);
+	m_ownedFrameIndices = QVector<quint32>(m_frameIndices, m_frameIndices + m_runCount);
+	m_arena.clear();
+	syncRuns();
+}
+
+void SxfColumn::syncRuns()
+{
+	m_runEnds = m_ownedRunEnds.constData();
+	m_marks = m_ownedMarks.constData();
+	m_frameIndices = m_ownedFrameIndices.constData();
+	m_runCount = m_ownedRunEnds.size();
 }
 
 void SxfSheet::read(QDataStream& stream)
@@ -258,23 +621,381 @@ void SxfSheet::read(QDataStream& stream)
 	stream >> size;
 	if (size < getSize())
 		throw std::runtime_error("SxfSheet block size is smaller than expected.");
-	columns.clear();
+	m_source.clear();
+	m_origin.clear();
+	m_sourceOffset = -1;
+	m_columns.clear();
 	quint32 readBytes = 0;
 	while (readBytes < size) {
 		SxfColumn column;
 		column.read(stream);
-		columns.append(column);
+		m_columns.append(column);
 		readBytes += 4 + column.getSize();
 	}
 }
 
-void SxfSheet::write(QDataStream& stream, quint16 blockId)
+// Bytes decoded so far in one decodeSheets() call, shared by the column workers
+class SxfLoadProgress {
+public:
+	SxfLoadProgress(const SxfProgressCallback& callback, qint64 total)
+		: m_callback(callback), m_total(total) {}
+
+	// Throws SxfLoadCancelled once the callback asked to stop
+	void advance(qint64 bytes) {
+		QMutexLocker locker(&m_mutex);
+		m_done += bytes;
+		if (m_cancelled || !m_callback(m_done, m_total)) {
+			m_cancelled = true;
+			throw SxfLoadCancelled();
+		}
+	}
+
+private:
+	SxfProgressCallback m_callback;
+	qint64 m_total;
+	qint64 m_done = 0;
+	bool m_cancelled = false;
+	QMutex m_mutex;
+};
+
+void SxfSheet::read(SxfByteReader& reader, SxfLoadProgress* progress)
+{
+	const qint64 sizeOffset = reader.pos();
+	quint32 size = reader.readU32();
+	if (size < getSize())
+		throw std::runtime_error("SxfSheet block size is smaller than expected.");
+	m_source.clear();
+	m_origin.clear();
+	m_sourceOffset = sizeOffset;
+	m_sourceSize = size;
+	m_columns.clear();
+
+	// Find the column boundaries by hopping their size prefixes, without decoding cells
+	const qint64 sheetEnd = reader.pos() + size;
+	QVarLengthArray<qint64, 256> columnOffsets;
+	while (reader.pos() < sheetEnd) {
+		columnOffsets.append(reader.pos());
+		reader.skip(reader.readU32());
+	}
+	if (reader.pos() != sheetEnd)
+		throw std::runtime_error("SxfColumn runs past the end of its sheet.");
+
+	// Paged sheets only read the column headers, the cells stay in the source
+	if (m_cache) {
+		m_columns.reserve(columnOffsets.size());
+		for (qint64 columnOffset : columnOffsets) {
+			reader.seek(columnOffset);
+			SxfColumn column;
+			column.readStub(reader);
+			m_columns.append(column);
+			if (progress)
+				progress->advance(4 + qint64(column.m_sourceSize));
+		}
+		reader.seek(sheetEnd);
+		return;
+	}
+
+	// Decode every column into its preallocated slot, concurrently for larger sheets
+	m_columns.resize(columnOffsets.size());
+	SxfColumn* columnSlots = m_columns.data();
+	const uchar* data = reader.data();
+	const qint64 dataSize = reader.size();
+	auto decodeColumn = [&](int index) {
+		SxfByteReader columnReader(data, dataSize);
+		columnReader.seek(columnOffsets[index]);
+		columnSlots[index].read(columnReader, m_arena);
+		if (progress)
+			progress->advance(4 + qint64(columnSlots[index].m_sourceSize));
+	};
+
+	if (!m_concurrentDecode || columnOffsets.size() < PARALLEL_DECODE_MIN_COLUMNS) {
+		for (int i = 0; i < columnOffsets.size(); i++) {
+			decodeColumn(i);
+		}
+		return;
+	}
+
+	// Exceptions must not escape a worker thread, keep the first one and rethrow it
+	// here. Once one is caught the remaining columns are skipped.
+	QVector<int> indices(columnOffsets.size());
+	std::iota(indices.begin(), indices.end(), 0);
+	QMutex errorMutex;
+	std::exception_ptr error;
+	std::atomic<bool> failed(false);
+	QtConcurrent::blockingMap(indices, [&](int index) {
+		if (failed)
+			return;
+		try {
+			decodeColumn(index);
+		}
+		catch (...) {
+			QMutexLocker locker(&errorMutex);
+			if (!error)
+				error = std::current_exception();
+			failed = true;
+		}
+	});
+	if (error)
+		std::rethrow_exception(error);
+}
+
+void SxfSheet::setDeferred(const QSharedPointer<const SxfSource>& source, qint64 sizeOffset, quint32 size)
+{
+	m_columns.clear();
+	m_source = source;
+	m_origin = source;
+	m_sourceOffset = sizeOffset;
+	m_sourceSize = size;
+
+	// Hop the column headers for the shortest and longest column, so a save can
+	// tell whether maxFrames cuts or pads the sheet without decoding it
+	m_sourceMinCells = std::numeric_limits<int>::max();
+	m_sourceMaxCells = 0;
+	SxfByteReader reader(source->data(), source->size());
+	reader.seek(sizeOffset + 4);
+	const qint64 sheetEnd = reader.pos() + size;
+	while (reader.pos() < sheetEnd) {
+		const qint64 columnOffset = reader.pos();
+		const quint32 columnSize = reader.readU32();
+		const quint32 headerSize = 2 + reader.readU16() + 4 + 4;
+		const int cells = columnSize > headerSize ? int((columnSize - headerSize) / SXF_CELL_SIZE) : 0;
+		m_sourceMinCells = qMin(m_sourceMinCells, cells);
+		m_sourceMaxCells = qMax(m_sourceMaxCells, cells);
+		reader.seek(columnOffset + 4 + columnSize);
+	}
+	m_sourceMinCells = qMin(m_sourceMinCells, m_sourceMaxCells);
+}
+
+bool SxfSheet::canCopyVerbatim(const SxfSource* source, bool trimEmptyTail, int maxCells) const
+{
+	if (!source || m_sourceOffset < 0 || m_origin.toStrongRef().data() != source)
+		return false;
+	if (!isDecoded())
+		return !trimEmptyTail && (maxCells < 0 || (m_sourceMinCells == maxCells && m_sourceMaxCells == maxCells));
+
+	// Every column must be unchanged and still sit where it was read from
+	qint64 expectedOffset = m_sourceOffset + 4;
+	for (const SxfColumn& column : m_columns) {
+		if (column.m_sourceOffset != expectedOffset || !column.canCopyVerbatim(source, trimEmptyTail, maxCells))
+			return false;
+		expectedOffset += 4 + column.m_sourceSize;
+	}
+	return expectedOffset == m_sourceOffset + 4 + m_sourceSize;
+}
+
+quint32 SxfSheet::getSavedSize(bool trimEmptyTail, int maxCells, const SxfSource* source) const
+{
+	if (canCopyVerbatim(source, trimEmptyTail, maxCells))
+		return m_sourceSize;
+	return getSize(trimEmptyTail, maxCells);
+}
+
+void SxfSheet::decodeDeferred(SxfLoadProgress* progress) const
+{
+	// Detach from the source first so read() sees an already decoded sheet
+	QSharedPointer<const SxfSource> source;
+	source.swap(m_source);
+
+	// On failure the sheet goes back to deferred with no columns, so the next
+	// access decodes and fails again instead of returning the columns read so far
+	auto restoreDeferred = [&]() {
+		m_columns.clear();
+		m_source = source;
+		m_origin = source;
+	};
+
+	SxfByteReader reader(source->data(), source->size());
+	reader.seek(m_sourceOffset);
+	try {
+		const_cast<SxfSheet*>(this)->read(reader, progress);
+		m_origin = source;
+	}
+	catch (const SxfLoadCancelled&) {
+		restoreDeferred();
+		throw;
+	}
+	catch (const std::runtime_error& e) {
+		restoreDeferred();
+		QString errorMsg = QString("Error while reading SXF data: %1").arg(e.what());
+		throw std::runtime_error(errorMsg.toStdString());
+	}
+	catch (...) {
+		restoreDeferred();
+		throw;
+	}
+}
+
+void SxfSheet::write(SxfByteWriter& writer, quint16 blockId, bool trimEmptyTail, int maxCells, const SxfSource* source) const
+{
+	writeBlockHeader(writer, blockId);
+	if (canCopyVerbatim(source, trimEmptyTail, maxCells)) {
+		writer.writeBytes(source->data() + m_sourceOffset, 4 + qint64(m_sourceSize));
+		return;
+	}
+
+	writer.writeU32(getSize(trimEmptyTail, maxCells));
+	const QVector<SxfColumn>& sheetColumns = columns();
+	for (int i = 0; i < sheetColumns.size(); i++) {
+		const SxfColumn& column = sheetColumns.at(i);
+		if (column.m_stub && !column.canCopyVerbatim(source, trimEmptyTail, maxCells)) {
+			// Header edited or cut or padded by maxCells on a column that was never
+			// decoded. Stubs are never trimmed, write exactly what getSize() counted.
+			SxfColumn decoded = this->column(i);
+			decoded.write(writer, false, column.savedCellCount(trimEmptyTail, maxCells), source);
+			continue;
+		}
+		column.write(writer, trimEmptyTail, maxCells, source);
+	}
+}
+
+SxfColumn SxfSheet::column(int index) const
+{
+	const SxfColumn& header = columns().at(index);
+	if (!header.m_stub)
+		return header;
+
+	// The header may have been edited since, the cache holds the source version
+	SxfColumn decoded = *m_cache->fetch(header.m_sourceOffset);
+	decoded.name = header.name;
+	decoded.isVisible = header.isVisible;
+	decoded.resv = header.resv;
+	return decoded;
+}
+
+SxfCell SxfSheet::cell(int column, int row) const
+{
+	const SxfColumn& header = columns().at(column);
+	if (row < 0 || row >= header.cellCount())
+		return { CellMark::None, 0 };
+	if (!header.m_stub)
+		return header.cell(row);
+	return m_cache->fetch(header.m_sourceOffset)->cell(row);
+}
+
+SxfColumn& SxfSheet::editColumn(int index)
+{
+	SxfColumn& column = columns()[index];
+	if (column.m_stub) {
+		column = this->column(index);
+	}
+	return column;
+}
+
+SxfColumnCache::SxfColumnCache(const QSharedPointer<const SxfSource>& source, qint64 budgetBytes)
+	: m_source(source)
+	, m_budget(budgetBytes)
+{
+}
+
+void SxfColumnCache::setBudget(qint64 budgetBytes)
+{
+	QMutexLocker locker(&m_mutex);
+	m_budget = budgetBytes;
+	evict();
+}
+
+qint64 SxfColumnCache::budget() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_budget;
+}
+
+qint64 SxfColumnCache::residentBytes() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_resident;
+}
+
+QSharedPointer<const SxfColumn> SxfColumnCache::fetch(qint64 sizeOffset)
+{
+	QMutexLocker locker(&m_mutex);
+	auto it = m_index.constFind(sizeOffset);
+	if (it != m_index.constEnd()) {
+		m_entries.splice(m_entries.begin(), m_entries, it.value());
+		return m_entries.front().column;
+	}
+	locker.unlock();
+
+	// Decode without the lock, so readers of other columns don't wait for it
+	SxfByteReader reader(m_source->data(), m_source->size());
+	reader.seek(sizeOffset);
+	QSharedPointer<SxfColumn> column = QSharedPointer<SxfColumn>::create();
+	column->read(reader);
+	const qint64 bytes = qint64(sizeof(SxfColumn)) + column->runCount() * qint64(sizeof(quint32) + sizeof(quint16) + sizeof(quint32));
+
+	locker.relock();
+	// Another thread may have decoded the same column meanwhile, keep its copy
+	it = m_index.constFind(sizeOffset);
+	if (it != m_index.constEnd()) {
+		m_entries.splice(m_entries.begin(), m_entries, it.value());
+		return m_entries.front().column;
+	}
+
+	Entry entry{ sizeOffset, column, bytes };
+	m_entries.push_front(entry);
+	m_index.insert(sizeOffset, m_entries.begin());
+	m_resident += entry.bytes;
+	evict();
+	return m_entries.front().column;
+}
+
+void SxfColumnCache::evict()
+{
+	// Always keep the most recent column, it is about to be used
+	while (m_resident > m_budget && m_entries.size() > 1) {
+		const Entry& last = m_entries.back();
+		m_resident -= last.bytes;
+		m_index.remove(last.offset);
+		m_entries.pop_back();
+	}
+}
+
+struct SxfArena::Block {
+	Block* previous;
+};
+
+SxfArena::~SxfArena()
+{
+	while (m_head) {
+		Block* previous = m_head->previous;
+		::operator delete(m_head);
+		m_head = previous;
+	}
+}
+
+void* SxfArena::allocate(qint64 size)
 {
-	writeBlockHeader(stream, blockId);
-	stream << getSize();
-	for (SxfColumn& column : columns) {
-		column.write(stream);
+	const qint64 alignment = alignof(std::max_align_t);
+	const qint64 headerSize = (qint64(sizeof(Block)) + alignment - 1) & ~(alignment - 1);
+	size = (size + alignment - 1) & ~(alignment - 1);
+
+	QMutexLocker locker(&m_mutex);
+	if (m_end - m_next < size) {
+		// Every new block at least doubles the arena, the rest of the old one is left unused
+		const qint64 blockSize = qMax(qMax(FIRST_BLOCK_SIZE, m_reserved), headerSize + size);
+		Block* block = static_cast<Block*>(::operator new(size_t(blockSize)));
+		block->previous = m_head;
+		m_head = block;
+		m_next = reinterpret_cast<char*>(block) + headerSize;
+		m_end = reinterpret_cast<char*>(block) + blockSize;
+		m_blockCount++;
+		m_reserved += blockSize;
 	}
+	void* memory = m_next;
+	m_next += size;
+	return memory;
+}
+
+int SxfArena::blockCount() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_blockCount;
+}
+
+qint64 SxfArena::reservedBytes() const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_reserved;
 }
 
 void SxfSound::read(QDataStream& stream)
@@ -283,20 +1004,39 @@ void SxfSound::read(QDataStream& stream)
 	stream >> size;
 	if (size < getSize(24))
 		throw std::runtime_error("SxfSound block size is smaller than expected.");
-	stream >> resv1;
-	// The rest is reserved data, skip it
-	stream.skipRawData(size - 4);
+	SxfSoundLayout::read(*this, stream);
+	// The rest is reserved data, keep a copy to write back
+	const quint32 reservedSize = size - SxfSoundLayout::size;
+	if (!hasEnoughBytes(stream, reservedSize))
+		throw std::runtime_error("SxfSound block runs past the end of the file.");
+	QByteArray reservedBytes(int(reservedSize), Qt::Uninitialized);
+	stream.readRawData(reservedBytes.data(), reservedBytes.size());
+	reserved = { QSharedPointer<const SxfSource>(new SxfSource(reservedBytes)), 0, reservedSize };
+}
+
+void SxfSound::read(SxfByteReader& reader, const QSharedPointer<const SxfSource>& source)
+{
+	quint32 size = reader.readU32();
+	if (size < getSize(24))
+		throw std::runtime_error("SxfSound block size is smaller than expected.");
+	SxfSoundLayout::read(*this, reader);
+	// The rest is reserved data, keep it as a slice of the source
+	const quint32 reservedSize = size - SxfSoundLayout::size;
+	reserved = { source, reader.pos(), reservedSize };
+	reader.skip(reservedSize);
 }
 
-void SxfSound::write(QDataStream& stream, quint32 frames)
+void SxfSound::write(SxfByteWriter& writer, quint32 frames)
 {
-	writeBlockHeader(stream, 0x05);
-	stream << getSize(frames);
-	stream << resv1;
-	// Write reserved data as zeros
-	quint32 reservedSize = getSize(frames) - 4;
-	QByteArray reservedData(reservedSize, 0);
-	stream.writeRawData(reservedData.constData(), reservedSize);
+	writeBlockHeader(writer, 0x05);
+	writer.writeU32(getSize(frames));
+	SxfSoundLayout::write(*this, writer);
+	// Reserved data goes back as read, frames added since are zeros
+	const qint64 reservedSize = getSize(frames) - SxfSoundLayout::size;
+	const qint64 keptSize = qMin<qint64>(reserved.size, reservedSize);
+	if (keptSize > 0)
+		writer.writeBytes(reserved.data(), keptSize);
+	writer.writeZeros(reservedSize - keptSize);
 }
 
 void SxfDialogue::read(QDataStream& stream)
@@ -305,14 +1045,22 @@ void SxfDialogue::read(QDataStream& stream)
 	stream >> size;
 	if (size < getSize())
 		throw std::runtime_error("SxfDialogue block size is smaller than expected.");
-	stream >> resv1;
+	SxfDialogueLayout::read(*this, stream);
+}
+
+void SxfDialogue::read(SxfByteReader& reader)
+{
+	quint32 size = reader.readU32();
+	if (size < getSize())
+		throw std::runtime_error("SxfDialogue block size is smaller than expected.");
+	SxfDialogueLayout::read(*this, reader);
 }
 
-void SxfDialogue::write(QDataStream& stream)
+void SxfDialogue::write(SxfByteWriter& writer)
 {
-	writeBlockHeader(stream, 0x06);
-	stream << getSize();
-	stream << resv1;
+	writeBlockHeader(writer, 0x06);
+	writer.writeU32(getSize());
+	SxfDialogueLayout::write(*this, writer);
 }
 
 void SxfDraw::read(QDataStream& stream)
@@ -321,20 +1069,28 @@ void SxfDraw::read(QDataStream& stream)
 	stream >> size;
 	if (size < getSize())
 		throw std::runtime_error("SxfDraw block size is smaller than expected.");
-	stream >> resv1;
-	stream >> resv2;
+	SxfDrawLayout::read(*this, stream);
 }
 
-void SxfDraw::write(QDataStream& stream)
+void SxfDraw::read(SxfByteReader& reader)
 {
-	writeBlockHeader(stream, 0x07);
-	stream << getSize();
-	stream << resv1;
-	stream << resv2;
+	quint32 size = reader.readU32();
+	if (size < getSize())
+		throw std::runtime_error("SxfDraw block size is smaller than expected.");
+	SxfDrawLayout::read(*this, reader);
+}
+
+void SxfDraw::write(SxfByteWriter& writer)
+{
+	writeBlockHeader(writer, 0x07);
+	writer.writeU32(getSize());
+	SxfDrawLayout::write(*this, writer);
 }
 
 void SxfData::read(QDataStream& stream)
 {
+	unknownBlocks.clear();
+	quint8 lastKnownId = 0;
 	while (!stream.atEnd()) {
 		quint8 blockId = readblockHeaderThrow(stream);
 		switch (blockId) {
@@ -359,13 +1115,235 @@ void SxfData::read(QDataStream& stream)
 		case 0x07:
 			simbolAndText.read(stream);
 			break;
+		default: {
+			// Newer block types are kept as they are and written back unchanged
+			quint32 size;
+			stream >> size;
+			if (!hasEnoughBytes(stream, size))
+				throw std::runtime_error(QString("Block 0x%1 runs past the end of the file.").arg(blockId, 2, 16, QChar('0')).toStdString());
+			QByteArray payload(int(size), Qt::Uninitialized);
+			stream.readRawData(payload.data(), payload.size());
+			unknownBlocks.append(SxfUnknownBlock{ blockId, lastKnownId, { QSharedPointer<const SxfSource>(new SxfSource(payload)), 0, size } });
+			continue;
+		}
+		}
+		lastKnownId = blockId;
+	}
+}
+
+void SxfData::write(SxfByteWriter& writer, const SxfSaveOptions& options)
+{
+	// Unknown blocks go back after the known block they followed in the file
+	auto writeUnknownBlocks = [&](quint8 afterId) {
+		for (const SxfUnknownBlock& block : qAsConst(unknownBlocks)) {
+			if (block.afterId == afterId) {
+				writeBlockHeader(writer, block.id);
+				writer.writeU32(block.payload.size);
+				if (block.payload.size > 0)
+					writer.writeBytes(block.payload.data(), block.payload.size);
+			}
+		}
+	};
+
+	// The small fixed-layout blocks are always re-encoded, the sheets are copied from
+	// source when unchanged, reserved and unknown bytes are always copied as read
+	writeUnknownBlocks(0x00);
+	property.write(writer);
+	writeUnknownBlocks(0x01);
+	note.write(writer);
+	writeUnknownBlocks(0x02);
+	actionSheet.write(writer, 0x03, options.trimTrailingEmptyCells, maxSavedCells(), source.data());
+	writeUnknownBlocks(0x03);
+	cellSheet.write(writer, 0x04, options.trimTrailingEmptyCells, maxSavedCells(), source.data());
+	writeUnknownBlocks(0x04);
+	sound.write(writer, property.maxFrames);
+	writeUnknownBlocks(0x05);
+	dialogue.write(writer);
+	writeUnknownBlocks(0x06);
+	simbolAndText.write(writer);
+	writeUnknownBlocks(0x07);
+}
+
+void SxfData::index(const QSharedPointer<SxfSource>& source)
+{
+	this->source = source;
+	SxfByteReader reader(source->data(), source->size());
+	reader.seek(8);// Magic Number + Version
+
+	// First pass: only hop over the size prefixes
+	blocks.clear();
+	blocks.reserve(8);// The known blocks, more only when the file has unknown ones
+	unknownBlocks.clear();
+	while (!reader.atEnd()) {
+		SxfBlockEntry entry;
+		entry.id = readblockHeaderThrow(reader);
+		entry.offset = reader.pos();
+		entry.size = reader.readU32();
+		if (entry.id == 0x02) {
+			// Earlier versions of this editor wrote the note size in UTF-16 units
+			// rather than bytes; trust the inner content length like read() does.
+			entry.size = 2 + reader.readU16() + 4;
+			reader.seek(entry.offset + 4);
+		}
+		reader.skip(entry.size);
+		blocks.append(entry);
+	}
+
+	// Second pass: decode everything but the sheets
+	quint8 lastKnownId = 0;
+	for (const SxfBlockEntry& entry : blocks) {
+		reader.seek(entry.offset);
+		switch (entry.id) {
+		case 0x01:
+			property.read(reader);
+			break;
+		case 0x02:
+			note.read(reader);
+			break;
+		case 0x03:
+			actionSheet.setDeferred(source, entry.offset, entry.size);
+			break;
+		case 0x04:
+			cellSheet.setDeferred(source, entry.offset, entry.size);
+			break;
+		case 0x05:
+			sound.read(reader, source);
+			break;
+		case 0x06:
+			dialogue.read(reader);
+			break;
+		case 0x07:
+			simbolAndText.read(reader);
+			break;
 		default:
-			throw std::runtime_error(QString("Unknown block ID: 0x%1").arg(blockId, 2, 16, QChar('0')).toStdString());
+			// Newer block types stay in the source and are written back unchanged
+			unknownBlocks.append(SxfUnknownBlock{ entry.id, lastKnownId, { source, entry.offset + 4, entry.size } });
+			continue;
 		}
+		lastKnownId = entry.id;
+	}
+}
+
+void SxfData::decodeSheets(const SxfProgressCallback& progress, bool concurrent)
+{
+	actionSheet.setConcurrentDecode(concurrent);
+	cellSheet.setConcurrentDecode(concurrent);
+	if (!progress) {
+		actionSheet.decode();
+		cellSheet.decode();
+		return;
 	}
+
+	// Everything outside the sheets' column data was decoded by index() already
+	const qint64 total = source ? source->size() : 0;
+	SxfLoadProgress loadProgress(progress, total);
+	loadProgress.advance(total - actionSheet.pendingSize() - cellSheet.pendingSize());
+	actionSheet.decode(&loadProgress);
+	cellSheet.decode(&loadProgress);
 }
 
-SxfData loadSxf(const QString& sxfFilePath) {
+void SxfByteReader::throwOutOfRange(qint64 count) const
+{
+	QString errorMsg = QString("Parsing error: Unexpected end of data, needed %1 bytes at offset %2 of %3.")
+		.arg(count).arg(m_pos).arg(m_size);
+	throw std::runtime_error(errorMsg.toStdString());
+}
+
+void SxfByteWriter::throwOutOfRange(qint64 count) const
+{
+	QString errorMsg = QString("Serialization error: Block sizes disagree with the data, %1 bytes do not fit at offset %2 of %3.")
+		.arg(count).arg(m_pos).arg(m_size);
+	throw std::runtime_error(errorMsg.toStdString());
+}
+
+SxfSource::SxfSource(const QString& filePath)
+	: m_filePath(filePath)
+	, m_file(filePath)
+{
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		QString errorMsg = QString("Failed to open file for reading: %1").arg(filePath);
+		throw std::runtime_error(errorMsg.toStdString());
+	}
+
+	m_size = m_file.size();
+	m_mapped = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+	if (!m_mapped) {
+		// Not mappable (empty file, sequential device...), keep a buffered copy instead
+		m_buffer = m_file.readAll();
+		m_size = m_buffer.size();
+		m_file.close();
+	}
+}
+
+SxfSource::SxfSource(const QByteArray& bytes)
+	: m_buffer(bytes)
+	, m_size(bytes.size())
+{
+}
+
+void SxfSource::detach()
+{
+	if (!m_mapped)
+		return;
+	if (m_size > std::numeric_limits<int>::max()) {
+		QString errorMsg = QString("File is too large to be replaced while it is open: %1").arg(m_filePath);
+		throw std::runtime_error(errorMsg.toStdString());
+	}
+
+	m_buffer = QByteArray(reinterpret_cast<const char*>(m_mapped), int(m_size));
+	m_file.unmap(m_mapped);
+	m_mapped = nullptr;
+	m_file.close();
+}
+
+void releaseSxfSource(SxfData& data, const QString& sxfFilePath) {
+#ifdef Q_OS_WIN
+	// A mapped file cannot be replaced on Windows, let go of it before the rename
+	if (data.source && QFileInfo(data.source->filePath()).canonicalFilePath() == QFileInfo(sxfFilePath).canonicalFilePath()) {
+		data.source->detach();
+	}
+#else
+	Q_UNUSED(data);
+	Q_UNUSED(sxfFilePath);
+#endif
+}
+
+SxfData loadSxf(const QString& sxfFilePath, SxfLoadMode mode) {
+	if (mode == SxfLoadMode::Mapped || mode == SxfLoadMode::Paged) {
+		QSharedPointer<SxfSource> source(new SxfSource(sxfFilePath));
+		SxfByteReader reader(source->data(), source->size());
+
+		// Check Magic Number(4 Bytes)
+		quint32 magicNumValue = source->size() >= 4 ? reader.readU32() : 0;
+		checkMagicNumber(magicNumValue, source->size());
+
+		// Check Version/number(4 Bytes)
+		// TODO: check version value if needed, not sure what 7 represents.
+		reader.readU32();
+
+		// Index Blocks, the sheets are decoded when first touched
+		SxfData data;
+		try {
+			data.index(source);
+			if (mode == SxfLoadMode::Paged) {
+				data.columnCache.reset(new SxfColumnCache(source));
+				data.actionSheet.setPaged(data.columnCache);
+				data.cellSheet.setPaged(data.columnCache);
+			}
+			else {
+				data.arena.reset(new SxfArena());
+				data.actionSheet.setArena(data.arena);
+				data.cellSheet.setArena(data.arena);
+			}
+		}
+		catch (const std::runtime_error& e) {
+			QString errorMsg = QString("Error while reading SXF data: %1").arg(e.what());
+			throw std::runtime_error(errorMsg.toStdString());
+		}
+
+		return data;
+	}
+
 	QFile file(sxfFilePath);
 
 	if (!file.open(QIODevice::ReadOnly)) {
@@ -381,17 +1359,11 @@ SxfData loadSxf(const QString& sxfFilePath) {
 
 	// Check Magic Number(4 Bytes)
 	quint32 magicNumValue;
-	const quint32 EXPECTED_MAGIC_VALUE = 0x57425343;//WBSC
 	stream >> magicNumValue;
-	if (magicNumValue != EXPECTED_MAGIC_VALUE) {
-		QString errorMsg = QString("File too short to contain Magic Number. Size: %1 bytes.")
-			.arg(rawContent.size());
-		throw std::runtime_error(errorMsg.toStdString());
-	}
+	checkMagicNumber(magicNumValue, rawContent.size());
 
 	// Check Version/number(4 Bytes)
 	quint32 magicVersionNumber;
-	const quint32 EXPECTED_VERSION_VALUE = 0x01000007;
 	stream >> magicVersionNumber;
 	// TODO: check version value if needed, not sure what 7 represents.
 
@@ -409,30 +1381,58 @@ SxfData loadSxf(const QString& sxfFilePath) {
 	return data;
 }
 
-void saveSxf(const QString& sxfFilePath, SxfData& data) {
-	QFile file(sxfFilePath);
-	if (!file.open(QIODevice::WriteOnly)) {
-		QString errorMsg = QString("Failed to open file for writing: %1").arg(sxfFilePath);
-		throw std::runtime_error(errorMsg.toStdString());
+QByteArray serializeSxf(SxfData& data, const SxfSaveOptions& options) {
+	const bool trim = options.trimTrailingEmptyCells;
+
+	// One sizing pass, then a single allocation of the exact file size
+	const qint64 totalSize = 8
+		+ BLOCK_HEADER_SIZE + data.property.getSize()
+		+ BLOCK_HEADER_SIZE + data.note.getSize()
+		+ BLOCK_HEADER_SIZE + data.actionSheet.getSavedSize(trim, data.maxSavedCells(), data.source.data())
+		+ BLOCK_HEADER_SIZE + data.cellSheet.getSavedSize(trim, data.maxSavedCells(), data.source.data())
+		+ BLOCK_HEADER_SIZE + data.sound.getSize(data.property.maxFrames)
+		+ BLOCK_HEADER_SIZE + data.dialogue.getSize()
+		+ BLOCK_HEADER_SIZE + data.simbolAndText.getSize()
+		+ std::accumulate(data.unknownBlocks.cbegin(), data.unknownBlocks.cend(), qint64(0),
+			[](qint64 size, const SxfUnknownBlock& block) { return size + BLOCK_HEADER_SIZE + block.payload.size; });
+
+	if (totalSize > std::numeric_limits<int>::max()) {
+		throw std::runtime_error("Serialization error: Sheet is too large to save.");
 	}
-	QDataStream stream(&file);
-	stream.setByteOrder(QDataStream::BigEndian);
+	QByteArray buffer(static_cast<int>(totalSize), Qt::Uninitialized);
+	SxfByteWriter writer(reinterpret_cast<uchar*>(buffer.data()), buffer.size());
 
 	// Write Magic Number(4 Bytes)
 	const quint32 MAGIC_VALUE = 0x57425343;//WBSC
-	stream << MAGIC_VALUE;
+	writer.writeU32(MAGIC_VALUE);
 
 	// Write Version/number(4 Bytes)
 	const quint32 VERSION_VALUE = 0x01000007;
-	stream << VERSION_VALUE;
+	writer.writeU32(VERSION_VALUE);
 
 	// Write Blocks
-	data.property.write(stream);
-	data.note.write(stream);
-	data.actionSheet.write(stream, 0x03);
-	data.cellSheet.write(stream, 0x04);
-	data.sound.write(stream, data.property.maxFrames);
-	data.dialogue.write(stream);
-	data.simbolAndText.write(stream);
-	file.close();
-}
\ No newline at end of file
+	data.write(writer, options);
+
+	if (writer.pos() != writer.size()) {
+		throw std::runtime_error("Serialization error: Block sizes disagree with the data.");
+	}
+	return buffer;
+}
+
+void saveSxf(const QString& sxfFilePath, SxfData& data, const SxfSaveOptions& options) {
+	// Serialize first so a failure leaves the target untouched
+	QByteArray buffer = serializeSxf(data, options);
+
+	releaseSxfSource(data, sxfFilePath);
+
+	// Written to a temporary file and renamed over the target on commit
+	QSaveFile file(sxfFilePath);
+	if (!file.open(QIODevice::WriteOnly)) {
+		QString errorMsg = QString("Failed to open file for writing: %1").arg(sxfFilePath);
+		throw std::runtime_error(errorMsg.toStdString());
+	}
+	if (file.write(buffer) != buffer.size() || !file.commit()) {
+		QString errorMsg = QString("Failed to write file: %1").arg(sxfFilePath);
+		throw std::runtime_error(errorMsg.toStdString());
+	}
+}
@@ -4,7 +4,19 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
+#include <QVector>
+#include <QFile>
+#include <QSharedPointer>
+#include <QHash>
+#include <QMutex>
+#include <QtEndian>
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <list>
+#include <stdexcept>
 
 
 enum TimeFormat : quint16 {
@@ -32,6 +44,218 @@ enum CellMark :quint16 {
 	Stop = 0x0008
 };
 
+enum class SxfLoadMode {
+	Stream,	// QFile::readAll() + QDataStream
+	Mapped,	// QFile::map(), blocks are decoded straight from the mapped bytes
+	Paged	// Like Mapped, but column cells stay in the file and go through SxfData::columnCache
+};
+
+struct SxfSaveOptions {
+	// Write each column only up to its last non-empty cell instead of the full
+	// padded length. loadSxf() reads short columns fine; other tools may not.
+	bool trimTrailingEmptyCells = false;
+};
+
+// Receives the bytes decoded so far and the file size. Returning false cancels the
+// load with SxfLoadCancelled. Called from the decoding threads, so it must be thread-safe.
+using SxfProgressCallback = std::function<bool(qint64 bytesDone, qint64 bytesTotal)>;
+
+class SxfLoadCancelled : public std::runtime_error {
+public:
+	SxfLoadCancelled() : std::runtime_error("Loading was cancelled.") {}
+};
+
+class SxfLoadProgress;
+
+// Bounds-checked big-endian reader over a read-only byte range (e.g. a mapped file).
+// Reading past the end throws std::runtime_error instead of returning garbage.
+class SxfByteReader {
+public:
+	SxfByteReader(const uchar* data, qint64 size) : m_data(data), m_size(size) {}
+
+	const uchar* data() const { return m_data; }
+	qint64 pos() const { return m_pos; }
+	qint64 size() const { return m_size; }
+	bool atEnd() const { return m_pos >= m_size; }
+
+	quint8 readU8() {
+		require(1);
+		return m_data[m_pos++];
+	}
+	quint16 readU16() {
+		require(2);
+		quint16 value = qFromBigEndian<quint16>(m_data + m_pos);
+		m_pos += 2;
+		return value;
+	}
+	quint32 readU32() {
+		require(4);
+		quint32 value = qFromBigEndian<quint32>(m_data + m_pos);
+		m_pos += 4;
+		return value;
+	}
+	const uchar* readBytes(qint64 count) {
+		require(count);
+		const uchar* bytes = m_data + m_pos;
+		m_pos += count;
+		return bytes;
+	}
+	void skip(qint64 count) {
+		require(count);
+		m_pos += count;
+	}
+	void seek(qint64 pos) {
+		m_pos = 0;
+		require(pos);
+		m_pos = pos;
+	}
+
+private:
+	void require(qint64 count) const {
+		if (count < 0 || m_size - m_pos < count)
+			throwOutOfRange(count);
+	}
+	[[noreturn]] void throwOutOfRange(qint64 count) const;
+
+	const uchar* m_data;
+	qint64 m_size;
+	qint64 m_pos = 0;
+};
+
+// Big-endian writer into a preallocated byte span, the counterpart of SxfByteReader.
+// Running past the end means the precomputed sizes were wrong, and throws.
+class SxfByteWriter {
+public:
+	SxfByteWriter(uchar* data, qint64 size) : m_data(data), m_size(size) {}
+
+	qint64 pos() const { return m_pos; }
+	qint64 size() const { return m_size; }
+
+	void writeU8(quint8 value) {
+		require(1);
+		m_data[m_pos++] = value;
+	}
+	void writeU16(quint16 value) {
+		require(2);
+		qToBigEndian<quint16>(value, m_data + m_pos);
+		m_pos += 2;
+	}
+	void writeU32(quint32 value) {
+		require(4);
+		qToBigEndian<quint32>(value, m_data + m_pos);
+		m_pos += 4;
+	}
+	void writeBytes(const void* bytes, qint64 count) {
+		require(count);
+		memcpy(m_data + m_pos, bytes, count);
+		m_pos += count;
+	}
+	void writeZeros(qint64 count) {
+		require(count);
+		memset(m_data + m_pos, 0, count);
+		m_pos += count;
+	}
+	// Hands out the next count bytes to be filled in place
+	uchar* claim(qint64 count) {
+		require(count);
+		uchar* bytes = m_data + m_pos;
+		m_pos += count;
+		return bytes;
+	}
+
+private:
+	void require(qint64 count) const {
+		if (count < 0 || m_size - m_pos < count)
+			throwOutOfRange(count);
+	}
+	[[noreturn]] void throwOutOfRange(qint64 count) const;
+
+	uchar* m_data;
+	qint64 m_size;
+	qint64 m_pos = 0;
+};
+
+// The bytes of an opened SXF file: mapped when possible, otherwise read into memory.
+// Shared by the sheets that are still waiting to be decoded from it.
+class SxfSource {
+public:
+	explicit SxfSource(const QString& filePath);
+	// Wraps bytes already in memory, filePath() is empty
+	explicit SxfSource(const QByteArray& bytes);
+
+	const uchar* data() const {
+		return m_mapped ? m_mapped : reinterpret_cast<const uchar*>(m_buffer.constData());
+	}
+	qint64 size() const { return m_size; }
+	const QString& filePath() const { return m_filePath; }
+
+	// Swaps the mapping for a private copy and closes the file. Not thread-safe:
+	// nothing may read data() meanwhile. Throws for files over 2 GB.
+	void detach();
+
+private:
+	Q_DISABLE_COPY(SxfSource)
+
+	QString m_filePath;
+	QFile m_file;
+	uchar* m_mapped = nullptr;
+	QByteArray m_buffer;
+	qint64 m_size = 0;
+};
+
+// Monotonic memory for the cell runs of a loaded document. Blocks grow
+// geometrically and are only freed together with the arena, so decoding a
+// document takes a handful of allocations however many columns it has. Thread-safe.
+class SxfArena {
+public:
+	static const qint64 FIRST_BLOCK_SIZE = 64 * 1024;
+
+	SxfArena() = default;
+	~SxfArena();
+
+	// size bytes aligned for any scalar type, valid until the arena is destroyed
+	void* allocate(qint64 size);
+
+	int blockCount() const;
+	qint64 reservedBytes() const;
+
+private:
+	Q_DISABLE_COPY(SxfArena)
+
+	struct Block;
+	mutable QMutex m_mutex;
+	Block* m_head = nullptr;// Newest block, linked to the older ones
+	char* m_next = nullptr;
+	char* m_end = nullptr;
+	int m_blockCount = 0;
+	qint64 m_reserved = 0;
+};
+
+// Location of one block in the file, recorded by SxfData::index()
+struct SxfBlockEntry {
+	quint8 id = 0;
+	qint64 offset = 0;// Offset of the 32-bit size prefix
+	quint32 size = 0;// Payload size, excluding the size prefix
+};
+
+// Bytes kept exactly as they were read, a slice of the source they came from.
+// Saving copies them back without decoding them.
+struct SxfRawBytes {
+	QSharedPointer<const SxfSource> source;
+	qint64 offset = 0;
+	quint32 size = 0;
+
+	const uchar* data() const { return source ? source->data() + offset : nullptr; }
+};
+
+// A block ID this version does not know. Written back unchanged after the
+// known block it followed in the file.
+struct SxfUnknownBlock {
+	quint8 id = 0;
+	quint8 afterId = 0;// Last known block before it, 0 if it came first
+	SxfRawBytes payload;
+};
+
 struct SxfProperty {
 	// Basic
 	quint16 resv1 = 7;
@@ -54,9 +278,10 @@ struct SxfProperty {
 	std::array<quint16, 7> widgets = { 6,1,4,8,2,10,19 };
 	std::array<quint32, 7> visibilities = { 1,1,1,0,1,1,1 };
 
-	const qint32 getSize() { return 84; }
+	static constexpr qint32 getSize() { return 84; }
 	void read(QDataStream& stream);
-	void write(QDataStream& stream);
+	void read(SxfByteReader& reader);
+	void write(SxfByteWriter& writer);
 
 	void setVisiblity(Visibility item, bool isVisible) {
 		visibilities[item] = isVisible ? 1 : 0;
@@ -70,72 +295,255 @@ struct SxfNote {
 	QString content;
 	quint32 bigFont = 0;
 
-	const quint32 getSize() {
-		quint16 contentSize = content.size();
-		return 2 + contentSize + 4;
-	}
+	const quint32 getSize();
 	void read(QDataStream& stream);
-	void write(QDataStream& stream);
+	void read(SxfByteReader& reader);
+	void write(SxfByteWriter& writer);
 };
 
 struct SxfCell {
 	quint16 mark = CellMark::None;
 	quint32 frameIndex = 0;// Store as ASCIIx8
-
-	void read(QDataStream& stream);
-	void write(QDataStream& stream);
 };
+
 struct SxfColumn {
 	QString name;// TODO:GBK? SHIFT_JIS? UTF-8?
 	// -BGΪֵlayer
 	quint32 isVisible = 1;
 	quint32 resv = 10;
-	QList<SxfCell> cells;
 
-	const quint32 getSize() {
-		return 2 + (quint32)(name.size()) + 4 + 4 + (quint32)(cells.size()) * 10;
+	// Cells are run-length encoded and stored column-wise (SoA): run i ends
+	// before row runEnds()[i] and every row in it holds marks()[i] and
+	// frameIndices()[i]. Blank spans and holds cost one run whatever their length.
+	int cellCount() const { return m_cellCount; }
+	SxfCell cell(int row) const {
+		const int run = runAt(row);
+		return { m_marks[run], m_frameIndices[run] };
 	}
+	void setCell(int row, const SxfCell& cell);
+	// Added cells are empty
+	void resizeCells(int count);
+	// Cell count without the trailing empty cells
+	int usedCellCount() const;
+
+	int runCount() const { return m_runCount; }
+	const quint32* runEnds() const { return m_runEnds; }
+	const quint16* marks() const { return m_marks; }
+	const quint32* frameIndices() const { return m_frameIndices; }
+
+	// Column-level codec: replaces the cells with count records from src, or
+	// writes the first count cells to dst (count * SXF_CELL_SIZE bytes), padded
+	// with empty cells past the end of the column.
+	// With an arena the runs are allocated from it until the column is edited.
+	void decodeCells(const uchar* src, quint32 count, const QSharedPointer<SxfArena>& arena = QSharedPointer<SxfArena>());
+	void encodeCells(uchar* dst, quint32 count) const;
+
+	// Cells write() saves: exactly maxCells, cut or padded with empty cells, or at
+	// most maxCells without the empty tail when trimming. A negative maxCells keeps
+	// the column's own length.
+	int savedCellCount(bool trimEmptyTail, int maxCells) const {
+		const int cells = trimEmptyTail ? usedCellCount() : cellCount();
+		if (maxCells < 0)
+			return cells;
+		return trimEmptyTail ? qMin(cells, maxCells) : maxCells;
+	}
+	const quint32 getSize(bool trimEmptyTail = false, int maxCells = -1) const {
+		quint32 savedCells = savedCellCount(trimEmptyTail, maxCells);
+		return 2 + (quint32)(name.toUtf8().size()) + 4 + 4 + savedCells * 10;
+	}
+	// True when the bytes this column was read from still describe it: the
+	// cells were not modified and the name and flags match the source.
+	bool isUnchangedSince(const SxfSource& source) const;
+
+	// A stub holds only the header of a paged column: cellCount() is right but
+	// the cells were never decoded, read them through SxfSheet::column()
+	bool isStub() const { return m_stub; }
+
 	void read(QDataStream& stream);
-	void write(QDataStream& stream);
+	void read(SxfByteReader& reader, const QSharedPointer<SxfArena>& arena = QSharedPointer<SxfArena>());
+	// Copies the column verbatim from source when it is unchanged since loading.
+	// Writes savedCellCount() cells.
+	void write(SxfByteWriter& writer, bool trimEmptyTail = false, int maxCells = -1,
+		const SxfSource* source = nullptr) const;
+
+private:
+	friend struct SxfSheet;
+
+	// Reads everything up to the cells and returns the size of the cell records
+	quint32 readHeader(SxfByteReader& reader);
+	void readStub(SxfByteReader& reader);
+
+	bool canCopyVerbatim(const SxfSource* source, bool trimEmptyTail, int maxCells) const {
+		return source && savedCellCount(trimEmptyTail, maxCells) == cellCount() && isUnchangedSince(*source);
+	}
+	int runAt(int row) const {
+		return int(std::upper_bound(m_runEnds, m_runEnds + m_runCount, quint32(row)) - m_runEnds);
+	}
+	void appendRun(quint16 mark, quint32 frameIndex, quint32 length);
+	void removeRun(int run);
+	// Copies arena runs into the owned vectors, call before modifying them
+	void detachRuns();
+	// Points the run views back at the owned vectors after they changed
+	void syncRuns();
+
+	// Run views: into the document's SxfArena after loading, into the owned
+	// vectors once the column was edited or when it was read without an arena
+	const quint32* m_runEnds = nullptr;
+	const quint16* m_marks = nullptr;
+	const quint32* m_frameIndices = nullptr;
+	int m_runCount = 0;
+	QSharedPointer<SxfArena> m_arena;// Keeps the arena alive for every copy viewing it
+	QVector<quint32> m_ownedRunEnds;
+	QVector<quint16> m_ownedMarks;
+	QVector<quint32> m_ownedFrameIndices;
+	int m_cellCount = 0;
+
+	// Where the column was read from in the document's SxfSource, -1 if not from one
+	qint64 m_sourceOffset = -1;// Size prefix
+	quint32 m_sourceSize = 0;// Excluding the size prefix
+	bool m_cellsDirty = true;
+	bool m_stub = false;
+};
+
+// Decoded columns of a paged document, kept within a memory budget. The least
+// recently used columns are dropped first. Thread-safe, shared by both sheets.
+class SxfColumnCache {
+public:
+	static const qint64 DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+	explicit SxfColumnCache(const QSharedPointer<const SxfSource>& source, qint64 budgetBytes = DEFAULT_BUDGET);
+
+	void setBudget(qint64 budgetBytes);
+	qint64 budget() const;
+	qint64 residentBytes() const;
+
+	// The column whose size prefix is at sizeOffset in the source, decoded on a
+	// miss. The lock is only held for the lookup, the column stays valid after eviction.
+	QSharedPointer<const SxfColumn> fetch(qint64 sizeOffset);
+
+private:
+	Q_DISABLE_COPY(SxfColumnCache)
+
+	struct Entry {
+		qint64 offset;
+		QSharedPointer<const SxfColumn> column;
+		qint64 bytes;
+	};
+	void evict();
+
+	QSharedPointer<const SxfSource> m_source;
+	mutable QMutex m_mutex;
+	std::list<Entry> m_entries;// Most recently used first
+	QHash<qint64, std::list<Entry>::iterator> m_index;
+	qint64 m_budget;
+	qint64 m_resident = 0;
 };
 
 struct SxfSheet {
-	QList<SxfColumn> columns;
+	// Decodes a deferred sheet on first access
+	QVector<SxfColumn>& columns() {
+		decode();
+		return m_columns;
+	}
+	const QVector<SxfColumn>& columns() const {
+		decode();
+		return m_columns;
+	}
+	bool isDecoded() const { return m_source.isNull(); }
+	// Bytes of column data still waiting in the source, 0 once decoded
+	quint32 pendingSize() const { return m_source ? m_sourceSize : 0; }
+	void decode(SxfLoadProgress* progress = nullptr) const {
+		if (m_source)
+			decodeDeferred(progress);
+	}
+
+	// Paged mode: columns() keeps only stubs of the columns that were never
+	// edited, their cells are decoded through cache on access. Set before decoding.
+	void setPaged(const QSharedPointer<SxfColumnCache>& cache) { m_cache = cache; }
+	bool isPaged() const { return !m_cache.isNull(); }
+	// Columns decoded by read() take their cell runs from arena. Set before decoding.
+	void setArena(const QSharedPointer<SxfArena>& arena) { m_arena = arena; }
+	// Larger sheets decode their columns on the global QThreadPool unless this is
+	// off, then everything runs on the calling thread. Set before decoding.
+	void setConcurrentDecode(bool concurrent) { m_concurrentDecode = concurrent; }
+	// Cell access that works for stubs too
+	SxfColumn column(int index) const;
+	SxfCell cell(int column, int row) const;
+	// Decodes a stub for editing, it then stays in memory (pinned) like any
+	// unpaged column. Only call it for columns about to change.
+	SxfColumn& editColumn(int index);
 
-	const quint32 getSize() {
+	// Postpones reading until columns() is first called. sizeOffset is the
+	// position of the block's size prefix in source.
+	void setDeferred(const QSharedPointer<const SxfSource>& source, qint64 sizeOffset, quint32 size);
+
+	// Const all the way down, so sizing and writing a save snapshot never
+	// detaches the column list it shares with the live document
+	const quint32 getSize(bool trimEmptyTail = false, int maxCells = -1) const {
 		quint32 totalSize = 0;
-		for (SxfColumn col : columns) {
-			totalSize += 4 + col.getSize();
+		for (const SxfColumn& col : columns()) {
+			totalSize += 4 + col.getSize(trimEmptyTail, maxCells);
 		}
 		return totalSize;
 	}
+	// Payload size write() will produce, without decoding a deferred sheet that is copied verbatim
+	quint32 getSavedSize(bool trimEmptyTail, int maxCells, const SxfSource* source) const;
+
 	void read(QDataStream& stream);
-	void write(QDataStream& stream, quint16 blockId);
+	void read(SxfByteReader& reader, SxfLoadProgress* progress = nullptr);
+	// Copies the whole block from source when no column changed, otherwise only the
+	// unchanged columns. Every column is cut or padded to maxCells.
+	void write(SxfByteWriter& writer, quint16 blockId, bool trimEmptyTail = false,
+		int maxCells = -1, const SxfSource* source = nullptr) const;
+
+private:
+	bool canCopyVerbatim(const SxfSource* source, bool trimEmptyTail, int maxCells) const;
+	void decodeDeferred(SxfLoadProgress* progress) const;
+
+	// Lazily filled from m_source, hence mutable. Not safe to decode from two threads at once.
+	// A QVector rather than a QList, which would allocate a node per column
+	mutable QVector<SxfColumn> m_columns;
+	mutable QSharedPointer<const SxfSource> m_source;
+	// Source the offsets below refer to, kept after decoding for verbatim saves
+	mutable QWeakPointer<const SxfSource> m_origin;
+	qint64 m_sourceOffset = -1;// Size prefix of the block, -1 if not read from a source
+	quint32 m_sourceSize = 0;// Excluding the size prefix
+	int m_sourceMinCells = 0;// Shortest and longest column in the source, found by setDeferred()
+	int m_sourceMaxCells = 0;
+	QSharedPointer<SxfColumnCache> m_cache;
+	QSharedPointer<SxfArena> m_arena;
+	bool m_concurrentDecode = true;
 };
 
 // Not sure what this section used for
 struct SxfSound {
 	quint32 resv1 = 6;
-	const quint32 getSize(quint32 frames) { return 6 * frames + 4; }
+	// The 6 bytes per frame after resv1 as read from the file. write() copies
+	// them back, cut or zero-padded when maxFrames changed. Empty for new documents.
+	SxfRawBytes reserved;
+	static constexpr quint32 getSize(quint32 frames) { return 6 * frames + 4; }
 	void read(QDataStream& stream);
-	void write(QDataStream& stream, quint32 frames);
+	void read(SxfByteReader& reader, const QSharedPointer<const SxfSource>& source);
+	void write(SxfByteWriter& writer, quint32 frames);
 };
 
 // Not sure what this section used for
 struct SxfDialogue {
 	quint16 resv1 = 0;
-	const quint32 getSize() { return 2; }
+	static constexpr quint32 getSize() { return 2; }
 	void read(QDataStream& stream);
-	void write(QDataStream& stream);
+	void read(SxfByteReader& reader);
+	void write(SxfByteWriter& writer);
 };
 
 // Not implemented
 struct SxfDraw {
 	quint32 resv1 = 0;
 	quint32 resv2 = 0;
-	const quint32 getSize() { return 8; }
+	static constexpr quint32 getSize() { return 8; }
 	void read(QDataStream& stream);
-	void write(QDataStream& stream);
+	void read(SxfByteReader& reader);
+	void write(SxfByteWriter& writer);
 };
 
 struct SxfData {
@@ -146,12 +554,44 @@ struct SxfData {
 	SxfSound sound;
 	SxfDialogue dialogue;
 	SxfDraw simbolAndText;
+
+	// File this data was indexed from and its block directory. Unchanged sheets
+	// and columns are copied from it verbatim on save.
+	QSharedPointer<SxfSource> source;
+	QVector<SxfBlockEntry> blocks;
+	// Only set for SxfLoadMode::Paged, setBudget() bounds the decoded cells
+	QSharedPointer<SxfColumnCache> columnCache;
+	// Cell runs of both sheets for SxfLoadMode::Mapped, freed in one go with
+	// the last column that still views it
+	QSharedPointer<SxfArena> arena;
+	// Blocks with IDs outside 0x01-0x07, in file order
+	QList<SxfUnknownBlock> unknownBlocks;
+
 	void read(QDataStream& stream);
-	void write(QDataStream& stream);
+	void write(SxfByteWriter& writer, const SxfSaveOptions& options);
+	// Sheet columns are saved with at most property.maxFrames cells, so they
+	// agree with the sound block. Longer columns keep their cells in memory.
+	int maxSavedCells() const {
+		return int(qMin<quint32>(property.maxFrames, std::numeric_limits<int>::max()));
+	}
+
+	// Records every block after the file header into the block directory, decodes
+	// the small blocks at once and leaves both sheets deferred until first touched.
+	void index(const QSharedPointer<SxfSource>& source);
+	// Forces the deferred sheets to decode, so parse errors surface here.
+	// progress may cancel, which throws SxfLoadCancelled. Without concurrent the
+	// columns are decoded on the calling thread only, for callers that bound their own threads.
+	void decodeSheets(const SxfProgressCallback& progress = SxfProgressCallback(), bool concurrent = true);
 };
 
-SxfData loadSxf(const QString& sxfFilePath);
-void saveSxf(const QString& sxfFilePath, SxfData& data);
+SxfData loadSxf(const QString& sxfFilePath, SxfLoadMode mode = SxfLoadMode::Mapped);
+// Encodes the whole file into one exactly sized buffer, reusing unchanged bytes of data.source
+QByteArray serializeSxf(SxfData& data, const SxfSaveOptions& options = SxfSaveOptions());
+void saveSxf(const QString& sxfFilePath, SxfData& data, const SxfSaveOptions& options = SxfSaveOptions());
+// On Windows a mapped file cannot be replaced: detaches data.source when it maps
+// sxfFilePath. saveSxf() does this itself, call it first on the thread that reads
+// the source when the save runs on another one.
+void releaseSxfSource(SxfData& data, const QString& sxfFilePath);
 
 // void loadSxfToXsh(const SxfData& sxfData, TXsheet xsh)
 // void loadXshToSxf(TXsheet* xsh, SxfData& sxfData);
@@ -2,6 +2,7 @@
 #include "sxfmodel.h"
 #include "sxfprocessor.h"
 #include "sxfmergeheaderview.h"
+#include "sxfcelldelegate.h"
 
 #include <QTableView>
 #include <QHeaderView>
@@ -20,11 +21,28 @@
 #include <QWidget>
 #include <QVBoxLayout>
 #include <QLabel> // New include
+#include <QLineEdit>
+#include <QStatusBar>
+#include <QStyle>
+#include <QProgressDialog>
+#include <QtConcurrent>
+
+namespace {
+	// Files at least this large are opened in SxfLoadMode::Paged, so the
+	// cells of columns that are not on screen stay in the mapped file
+	constexpr qint64 PAGED_LOAD_MIN_BYTES = 64 * 1024 * 1024;
+}
 
 SxfViewer::SxfViewer(QWidget* parent)
 	: QMainWindow(parent)
 {
+	m_document = QSharedPointer<SxfData>::create();
 	m_model = new SxfModel(this);
+	m_model->setDocument(m_document);
+	m_loadWatcher = new QFutureWatcher<SxfLoadResult>(this);
+	connect(m_loadWatcher, &QFutureWatcher<SxfLoadResult>::finished, this, &SxfViewer::onLoadFinished);
+	m_saveWatcher = new QFutureWatcher<QString>(this);
+	connect(m_saveWatcher, &QFutureWatcher<QString>::finished, this, &SxfViewer::onSaveFinished);
 	setupActions();
 	setupMenus();
 	setupUi(); // setupUi will call the property editor setup functions
@@ -35,18 +53,30 @@ SxfViewer::SxfViewer(QWidget* parent)
 
 SxfViewer::~SxfViewer()
 {
+	// The worker reports to this object, stop it before going away
+	if (m_loadWatcher->isRunning()) {
+		m_cancelLoad = true;
+		m_loadWatcher->waitForFinished();
+	}
+	// Never drop a save that is still being written
+	m_saveWatcher->waitForFinished();
 }
 
 void SxfViewer::setupUi()
 {
 	m_tableView = new QTableView(this);
 	m_tableView->setModel(m_model);
+	m_tableView->setItemDelegate(new SxfCellDelegate(m_tableView));
 
 	SxfMergeHeaderView* header = new SxfMergeHeaderView(Qt::Horizontal, m_tableView);
 	header->setModel(m_model);
 	m_tableView->setHorizontalHeader(header);
 
 	m_tableView->verticalHeader()->setVisible(false);
+	// Uniform row heights, rows are never measured
+	m_tableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+	m_tableView->verticalHeader()->setDefaultSectionSize(m_tableView->fontMetrics().height() + 6);
+	m_tableView->horizontalHeader()->setSectionResizeMode(QHeaderView::Interactive);
 	m_tableView->horizontalHeader()->setStretchLastSection(true);
 	m_tableView->setAlternatingRowColors(true);
 
@@ -62,6 +92,14 @@ void SxfViewer::setupUi()
 	// --- New Signal Connection ---
 	// Connect header click to our new slot
 	connect(header, &SxfMergeHeaderView::columnSelected, this, &SxfViewer::onColumnSelected);
+
+	// Editing past the last frame grows the document, keep the spin box in step
+	auto syncMaxFrames = [this]() {
+		QSignalBlocker blocker(m_maxFramesSpinBox);
+		m_maxFramesSpinBox->setValue(m_document->property.maxFrames);
+	};
+	connect(m_model, &QAbstractItemModel::modelReset, this, syncMaxFrames);
+	connect(m_model, &QAbstractItemModel::rowsInserted, this, syncMaxFrames);
 }
 void SxfViewer::setupGlobalPropertyEditor()
 {
@@ -171,7 +209,8 @@ void SxfViewer::setupGlobalPropertyEditor()
 	// --- Connect signals ---
 	// Basic Properties
 	connect(m_fpsSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SxfViewer::onPropertyEdited);
-	connect(m_maxFramesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SxfViewer::onPropertyEdited);
+	// Frame count changes go through the model so the view gets the row change
+	connect(m_maxFramesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), m_model, &SxfModel::setMaxFrames);
 	connect(m_layerCountSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SxfViewer::onPropertyEdited);
 
 	// Scene/Cut info
@@ -205,19 +244,24 @@ void SxfViewer::setupColumnPropertyEditor()
 	QWidget* dockWidgetContents = new QWidget;
 	QFormLayout* layout = new QFormLayout(dockWidgetContents);
 
-	m_colNameLabel = new QLabel("-"); // Placeholder text
+	m_colNameEdit = new QLineEdit;
 	m_colVisibleCheck = new QCheckBox("Visible");
+	m_colResvSpinBox = new QSpinBox;
+	m_colResvSpinBox->setRange(0, INT_MAX);
 
-	layout->addRow("Column Name:", m_colNameLabel);
+	layout->addRow("Column Name:", m_colNameEdit);
 	layout->addRow(m_colVisibleCheck);
+	layout->addRow("Reserved:", m_colResvSpinBox);
 
 	m_columnPropertyDock->setWidget(dockWidgetContents);
 
 	// Disable by default until a column is selected
 	m_columnPropertyDock->setEnabled(false);
 
-	// Connect the checkbox
+	// Connect the editors
+	connect(m_colNameEdit, &QLineEdit::editingFinished, this, &SxfViewer::onColumnPropertyEdited);
 	connect(m_colVisibleCheck, &QCheckBox::stateChanged, this, &SxfViewer::onColumnPropertyEdited);
+	connect(m_colResvSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &SxfViewer::onColumnPropertyEdited);
 }
 
 // (setupActions and setupMenus are unchanged)
@@ -249,7 +293,7 @@ void SxfViewer::setupMenus()
 	fileMenu->addAction(m_exitAction);
 }
 /**
- * @brief Populates the global property editor widgets from the m_sxfData structure.
+ * @brief Populates the global property editor widgets from the shared document.
  */
 void SxfViewer::populatePropertyEditor()
 {
@@ -273,62 +317,61 @@ void SxfViewer::populatePropertyEditor()
 	// ---------------------------------------------------
 
 	// Populate SxfProperty - Info
-	m_sceneSpinBox->setValue(m_sxfData.property.sceneNumber);
-	m_cutSpinBox->setValue(m_sxfData.property.cutNumber);
+	m_sceneSpinBox->setValue(m_document->property.sceneNumber);
+	m_cutSpinBox->setValue(m_document->property.cutNumber);
 
 	// Populate SxfProperty - Timing & Others
-	m_fpsSpinBox->setValue(m_sxfData.property.fps);
-	m_rulerIntervalSpinBox->setValue(m_sxfData.property.rulerInterval); // <-- 新增
-	m_framePerPageSpinBox->setValue(m_sxfData.property.framePerPage); // <-- 新增
-	m_maxFramesSpinBox->setValue(m_sxfData.property.maxFrames); // <-- 新增加载
-	m_layerCountSpinBox->setValue(m_sxfData.property.layerCount); // <-- 新增加载
+	m_fpsSpinBox->setValue(m_document->property.fps);
+	m_rulerIntervalSpinBox->setValue(m_document->property.rulerInterval); // <-- 新增
+	m_framePerPageSpinBox->setValue(m_document->property.framePerPage); // <-- 新增
+	m_maxFramesSpinBox->setValue(m_document->property.maxFrames); // <-- 新增加载
+	m_layerCountSpinBox->setValue(m_document->property.layerCount); // <-- 新增加载
 
-	int comboIndex = m_timeFormatCombo->findData(m_sxfData.property.timeFormat);
+	int comboIndex = m_timeFormatCombo->findData(m_document->property.timeFormat);
 	m_timeFormatCombo->setCurrentIndex(qMax(0, comboIndex));
 
 	// Populate Visibilities (Unchanged)
-	m_visActionCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::ACTION));
-	m_visCellCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::CELL));
-	m_visDialogueCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::DIALOGUE));
-	m_visSoundCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::SOUND));
-	m_visCameraCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::CAMERA));
-	m_visNoteCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::NOTE));
-	m_visBasicInfoCheck->setChecked(m_sxfData.property.getVisiblity(Visibility::BASIC_INFO));
+	m_visActionCheck->setChecked(m_document->property.getVisiblity(Visibility::ACTION));
+	m_visCellCheck->setChecked(m_document->property.getVisiblity(Visibility::CELL));
+	m_visDialogueCheck->setChecked(m_document->property.getVisiblity(Visibility::DIALOGUE));
+	m_visSoundCheck->setChecked(m_document->property.getVisiblity(Visibility::SOUND));
+	m_visCameraCheck->setChecked(m_document->property.getVisiblity(Visibility::CAMERA));
+	m_visNoteCheck->setChecked(m_document->property.getVisiblity(Visibility::NOTE));
+	m_visBasicInfoCheck->setChecked(m_document->property.getVisiblity(Visibility::BASIC_INFO));
 
 	// Populate SxfNote (Unchanged)
-	m_noteEditor->setPlainText(m_sxfData.note.content);
+	m_noteEditor->setPlainText(m_document->note.content);
 }
 
 /**
  * @brief Called when any global property widget is edited.
- * Updates the master m_sxfData copy in the viewer.
+ * Updates the shared document in place.
  */
 void SxfViewer::onPropertyEdited()
 {
 	// Update SxfProperty - Info
-	m_sxfData.property.sceneNumber = m_sceneSpinBox->value();
-	m_sxfData.property.cutNumber = m_cutSpinBox->value();
+	m_document->property.sceneNumber = m_sceneSpinBox->value();
+	m_document->property.cutNumber = m_cutSpinBox->value();
 
 	// Update SxfProperty - Timing & Others
-	m_sxfData.property.fps = m_fpsSpinBox->value();
-	m_sxfData.property.rulerInterval = m_rulerIntervalSpinBox->value(); // <-- 新增
-	m_sxfData.property.framePerPage = m_framePerPageSpinBox->value(); // <-- 新增
-	m_sxfData.property.maxFrames = m_maxFramesSpinBox->value(); // <-- 新增修改
-	m_sxfData.property.layerCount = m_layerCountSpinBox->value(); // <-- 新增修改
+	m_document->property.fps = m_fpsSpinBox->value();
+	m_document->property.rulerInterval = m_rulerIntervalSpinBox->value(); // <-- 新增
+	m_document->property.framePerPage = m_framePerPageSpinBox->value(); // <-- 新增
+	m_document->property.layerCount = m_layerCountSpinBox->value(); // <-- 新增修改
 
-	m_sxfData.property.timeFormat = m_timeFormatCombo->currentData().toUInt();
+	m_document->property.timeFormat = m_timeFormatCombo->currentData().toUInt();
 
 	// Update Visibilities (Unchanged)
-	m_sxfData.property.setVisiblity(Visibility::ACTION, m_visActionCheck->isChecked());
-	m_sxfData.property.setVisiblity(Visibility::CELL, m_visCellCheck->isChecked());
-	m_sxfData.property.setVisiblity(Visibility::DIALOGUE, m_visDialogueCheck->isChecked());
-	m_sxfData.property.setVisiblity(Visibility::SOUND, m_visSoundCheck->isChecked());
-	m_sxfData.property.setVisiblity(Visibility::CAMERA, m_visCameraCheck->isChecked());
-	m_sxfData.property.setVisiblity(Visibility::NOTE, m_visNoteCheck->isChecked());
-	m_sxfData.property.setVisiblity(Visibility::BASIC_INFO, m_visBasicInfoCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::ACTION, m_visActionCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::CELL, m_visCellCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::DIALOGUE, m_visDialogueCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::SOUND, m_visSoundCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::CAMERA, m_visCameraCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::NOTE, m_visNoteCheck->isChecked());
+	m_document->property.setVisiblity(Visibility::BASIC_INFO, m_visBasicInfoCheck->isChecked());
 
 	// Update SxfNote (Unchanged)
-	m_sxfData.note.content = m_noteEditor->toPlainText();
+	m_document->note.content = m_noteEditor->toPlainText();
 }
 
 
@@ -340,55 +383,60 @@ void SxfViewer::onPropertyEdited()
  */
 void SxfViewer::onColumnSelected(int logicalIndex)
 {
+	// The header takes no focus, so a rename still being typed never got
+	// editingFinished: apply it to the column it was typed for first
+	if (m_colNameEdit->isModified()) {
+		onColumnPropertyEdited();
+	}
+
 	m_selectedColumnIndex = logicalIndex;
 	SxfColumn* column = getColumnFromData(logicalIndex);
 
 	if (!column) {
 		// This is the "Frame" column (index 0) or an invalid index
-		m_colNameLabel->setText("-");
+		QSignalBlocker nameBlocker(m_colNameEdit);
+		QSignalBlocker visibleBlocker(m_colVisibleCheck);
+		QSignalBlocker resvBlocker(m_colResvSpinBox);
+
+		m_colNameEdit->clear();
 		m_colVisibleCheck->setChecked(false);
+		m_colResvSpinBox->setValue(0);
 		m_columnPropertyDock->setEnabled(false);
 	}
 	else {
-		// This is a valid data column
-		QSignalBlocker blocker(m_colVisibleCheck); // Block signals while populating
+		// This is a valid data column; block signals while populating
+		QSignalBlocker nameBlocker(m_colNameEdit);
+		QSignalBlocker visibleBlocker(m_colVisibleCheck);
+		QSignalBlocker resvBlocker(m_colResvSpinBox);
 
-		m_colNameLabel->setText(column->name);
+		m_colNameEdit->setText(column->name);
 		m_colVisibleCheck->setChecked(column->isVisible != 0);
+		m_colResvSpinBox->setValue(static_cast<int>(qMin<quint32>(column->resv, INT_MAX)));
 		m_columnPropertyDock->setEnabled(true);
 	}
 }
 
 // --- New Slot: Column Property Edited ---
 /**
- * @brief Called when a column property (e.g., 'Visible' checkbox) is changed.
- * Updates the m_sxfData and reloads the model to reflect the change.
+ * @brief Called when a column property (name, 'Visible' or reserved) is changed.
+ * Updates the column through the model; only a rename repaints its header section.
  */
 void SxfViewer::onColumnPropertyEdited()
 {
-	SxfColumn* column = getColumnFromData(m_selectedColumnIndex);
-	if (!column) {
-		return; // Should not happen if the dock is enabled, but good to check
-	}
-
-	// 1. Update the SxfColumn in our master data
-	column->isVisible = m_colVisibleCheck->isChecked() ? 1 : 0;
-
-	// 2. Reload the model with the modified m_sxfData
-	// This pushes the change (e.g., isVisible=0) into the model's copy.
 	// The model currently doesn't hide the column, but the data is updated
 	// for when we save.
-	m_model->loadData(m_sxfData);
-
-	// 3. Re-trigger group calculation for the header
-	if (auto header = qobject_cast<SxfMergeHeaderView*>(m_tableView->horizontalHeader())) {
-		header->calculateGroups();
-	}
+	m_model->setColumnName(m_selectedColumnIndex, m_colNameEdit->text());
+	m_colNameEdit->setModified(false);
+	m_model->setColumnVisible(m_selectedColumnIndex, m_colVisibleCheck->isChecked());
+	// Values above INT_MAX are shown clamped; keep them unless the spin box was edited
+	const SxfColumn* column = getColumnFromData(m_selectedColumnIndex);
+	if (column && m_colResvSpinBox->value() != static_cast<int>(qMin<quint32>(column->resv, INT_MAX)))
+		m_model->setColumnResv(m_selectedColumnIndex, static_cast<quint32>(m_colResvSpinBox->value()));
 }
 
 // --- New Helper Function ---
 /**
- * @brief Gets a pointer to the SxfColumn in m_sxfData based on the logical column index.
+ * @brief Gets a pointer to the SxfColumn in the shared document based on the logical column index.
  * @param logicalIndex The logical index (from the model).
  * @return Pointer to the SxfColumn, or nullptr if not found or index is 0.
  */
@@ -400,18 +448,18 @@ SxfColumn* SxfViewer::getColumnFromData(int logicalIndex)
 
 	// We must use the model to get the area (ACTION or CELL)
 	int area = m_model->getColumnArea(logicalIndex);
-	int actionCount = m_sxfData.actionSheet.columns.length();
+	int actionCount = m_document->actionSheet.columns().length();
 	int cellIdx = logicalIndex - 1; // 0-based index for data columns
 
 	if (area == 0) { // ACTION
 		if (cellIdx < actionCount) {
-			return &m_sxfData.actionSheet.columns[cellIdx];
+			return &m_document->actionSheet.columns()[cellIdx];
 		}
 	}
 	else if (area == 1) { // CELL
 		cellIdx -= actionCount; // Adjust index for cellSheet
-		if (cellIdx < m_sxfData.cellSheet.columns.length()) {
-			return &m_sxfData.cellSheet.columns[cellIdx];
+		if (cellIdx < m_document->cellSheet.columns().length()) {
+			return &m_document->cellSheet.columns()[cellIdx];
 		}
 	}
 
@@ -421,105 +469,217 @@ SxfColumn* SxfViewer::getColumnFromData(int logicalIndex)
 
 void SxfViewer::onOpen()
 {
+	if (m_loadWatcher->isRunning()) {
+		return; // One load at a time
+	}
+
 	QString filePath = QFileDialog::getOpenFileName(this, "Open SXF File", "", "SXF Files (*.sxf);;All Files (*)");
 	if (filePath.isEmpty()) {
 		return;
 	}
 
-	// Load into the member variable
-	try {
-		m_sxfData = loadSxf(filePath);
+	m_loadingPath = filePath;
+	m_cancelLoad = false;
+	m_loadPermille = -1;
+
+	m_loadProgress = new QProgressDialog(QString("Loading %1...").arg(QFileInfo(filePath).fileName()), "Cancel", 0, 1000, this);
+	m_loadProgress->setWindowModality(Qt::WindowModal);
+	m_loadProgress->setMinimumDuration(300);
+	m_loadProgress->setValue(0);
+	connect(m_loadProgress, &QProgressDialog::canceled, this, [this]() { m_cancelLoad = true; });
+
+	// Parse on a worker so the event loop keeps running; the current document
+	// stays untouched until onLoadFinished() swaps the result in
+	m_loadWatcher->setFuture(QtConcurrent::run([this, filePath]() {
+		SxfLoadResult result;
+		try {
+			const bool paged = QFileInfo(filePath).size() >= PAGED_LOAD_MIN_BYTES;
+			result.data = loadSxf(filePath, paged ? SxfLoadMode::Paged : SxfLoadMode::Mapped);
+			// The table needs both sheets anyway, decode them here so errors are reported
+			result.data.decodeSheets([this](qint64 bytesDone, qint64 bytesTotal) {
+				const int permille = bytesTotal > 0 ? int(bytesDone * 1000 / bytesTotal) : 0;
+				if (m_loadPermille.exchange(permille) != permille) {
+					QMetaObject::invokeMethod(this, [this, permille]() {
+						if (m_loadProgress)
+							m_loadProgress->setValue(permille);
+					}, Qt::QueuedConnection);
+				}
+				return !m_cancelLoad;
+			});
+		}
+		catch (const SxfLoadCancelled&) {
+			result.cancelled = true;
+		}
+		catch (const std::runtime_error& e) {
+			result.error = QString::fromUtf8(e.what());
+		}
+		return result;
+	}));
+}
+
+/**
+ * @brief Called on the GUI thread when the background load ends.
+ * Swaps the loaded document in and refreshes the whole UI in one go.
+ */
+void SxfViewer::onLoadFinished()
+{
+	SxfLoadResult result = m_loadWatcher->result();
+	const QString filePath = m_loadingPath;
+
+	if (m_loadProgress) {
+		m_loadProgress->close();
+		m_loadProgress->deleteLater();
+		m_loadProgress = nullptr;
 	}
-	catch (const std::runtime_error& e) {
-		QMessageBox::warning(this, "Error", QString("Failed to load SXF file:\n%1").arg(e.what()));
+
+	if (result.cancelled) {
 		return;
 	}
-
-	if (m_sxfData.property.maxFrames == 0 && m_sxfData.property.layerCount == 0) {
+	if (!result.error.isEmpty()) {
+		QMessageBox::warning(this, "Error", QString("Failed to load SXF file:\n%1").arg(result.error));
+		return;
+	}
+	if (result.data.property.maxFrames == 0 && result.data.property.layerCount == 0) {
 		QMessageBox::warning(this, "Error", "Failed to parse SXF file or file is empty.");
 		return;
 	}
 
-	// 1. Load data into the table model
-	m_model->loadData(m_sxfData);
+	m_document = QSharedPointer<SxfData>::create(std::move(result.data));
+
+	// 1. Size the columns from their names, then hand the document to the table model.
+	// Sections created by the reset start at the default size, nothing is measured per section.
+	QHeaderView* hHeader = m_tableView->horizontalHeader();
+	hHeader->setDefaultSectionSize(dataColumnWidth());
+	m_model->setDocument(m_document);
+	if (m_model->columnCount() > 0) {
+		hHeader->resizeSection(0, frameColumnWidth());
+	}
 
 	// 2. Populate the new global property editor
 	populatePropertyEditor();
 
-	// 3. Reset/disable the column property editor
+	// 3. Reset/disable the column property editor. A rename still being typed
+	// belonged to the previous document, drop it.
+	m_colNameEdit->setModified(false);
 	onColumnSelected(-1);
 
 	if (auto header = qobject_cast<SxfMergeHeaderView*>(m_tableView->horizontalHeader())) {
 		header->calculateGroups();
 	}
 
-	// (La lógica de ajuste de columnas existente no cambia)
-	// --- [Existing Column Resizing Logic] ---
+	setWindowTitle(QString("SXF Editor - %1").arg(QFileInfo(filePath).fileName()));
+}
+
+/**
+ * @brief Width of a column name in the header font, cached per name.
+ */
+int SxfViewer::columnNameWidth(const QString& name)
+{
 	QHeaderView* hHeader = m_tableView->horizontalHeader();
-	int columnCount = m_model->columnCount();
+	if (hHeader->font() != m_nameWidthFont) {
+		m_nameWidthCache.clear();
+		m_nameWidthFont = hHeader->font();
+	}
+
+	auto it = m_nameWidthCache.constFind(name);
+	if (it != m_nameWidthCache.constEnd()) {
+		return it.value();
+	}
+	const int margin = hHeader->style()->pixelMetric(QStyle::PM_HeaderMargin, nullptr, hHeader);
+	const int width = hHeader->fontMetrics().horizontalAdvance(name) + 2 * margin;
+	m_nameWidthCache.insert(name, width);
+	return width;
+}
+
+/**
+ * @brief One shared width for all data columns of m_document, from the widest name.
+ */
+int SxfViewer::dataColumnWidth()
+{
 	const int MIN_CONTENT_WIDTH = 50;
 	const int HEADER_TEXT_BUFFER = 20;
-	int desiredDataColumnWidth = MIN_CONTENT_WIDTH;
-	hHeader->setSectionResizeMode(QHeaderView::ResizeToContents);
+	const int ABSOLUTE_MAX_CAP = 150;
+
 	int maxHeaderWidth = 0;
-	for (int i = 1; i < columnCount; ++i) {
-		int currentWidth = hHeader->sectionSize(i);
-		if (currentWidth > maxHeaderWidth) {
-			maxHeaderWidth = currentWidth;
+	for (const SxfSheet* sheet : { &m_document->actionSheet, &m_document->cellSheet }) {
+		for (const SxfColumn& column : sheet->columns()) {
+			maxHeaderWidth = qMax(maxHeaderWidth, columnNameWidth(column.name));
 		}
 	}
+
+	int desiredDataColumnWidth = MIN_CONTENT_WIDTH;
 	if (maxHeaderWidth > desiredDataColumnWidth) {
 		desiredDataColumnWidth = (int)(maxHeaderWidth * 0.8) + HEADER_TEXT_BUFFER;
 	}
 	else {
 		desiredDataColumnWidth += HEADER_TEXT_BUFFER;
 	}
-	const int ABSOLUTE_MAX_CAP = 150;
-	if (desiredDataColumnWidth > ABSOLUTE_MAX_CAP) {
-		desiredDataColumnWidth = ABSOLUTE_MAX_CAP;
-	}
-	if (columnCount > 0) {
-		const int MIN_FRAME_WIDTH = 50;
-		int frameWidth = hHeader->sectionSize(0);
-		if (frameWidth < MIN_FRAME_WIDTH) frameWidth = MIN_FRAME_WIDTH;
-		hHeader->setSectionResizeMode(0, QHeaderView::Fixed);
-		hHeader->resizeSection(0, frameWidth);
-		for (int i = 1; i < columnCount; ++i) {
-			hHeader->setSectionResizeMode(i, QHeaderView::Fixed);
-			hHeader->resizeSection(i, desiredDataColumnWidth);
-		}
-	}
-	hHeader->setSectionResizeMode(QHeaderView::Interactive);
-	hHeader->setStretchLastSection(true);
-	// --- [End Resizing Logic] ---
+	return qMin(desiredDataColumnWidth, ABSOLUTE_MAX_CAP);
+}
 
-	setWindowTitle(QString("SXF Editor - %1").arg(QFileInfo(filePath).fileName()));
+/**
+ * @brief Width of the "Frame" column, wide enough for its header and the last frame number.
+ */
+int SxfViewer::frameColumnWidth()
+{
+	const int MIN_FRAME_WIDTH = 50;
+	QHeaderView* hHeader = m_tableView->horizontalHeader();
+	const int margin = hHeader->style()->pixelMetric(QStyle::PM_HeaderMargin, nullptr, hHeader);
+	const int numberWidth = m_tableView->fontMetrics().horizontalAdvance(QString::number(m_document->property.maxFrames)) + 2 * margin;
+	return qMax(MIN_FRAME_WIDTH, qMax(columnNameWidth("Frame"), numberWidth));
 }
 
 void SxfViewer::onSaveAs()
 {
+	if (m_saveWatcher->isRunning()) {
+		statusBar()->showMessage(QString("Still saving %1...").arg(QFileInfo(m_savingPath).fileName()));
+		return;
+	}
+
 	QString filePath = QFileDialog::getSaveFileName(this, "Save SXF File", "", "SXF Files (*.sxf);;All Files (*)");
 	if (filePath.isEmpty()) {
 		return;
 	}
 
-	// 1. Get the table data (action/cell sheets, maxFrames) from the model.
-	// This copy now includes any edits to cells AND any edits to column visibility
-	// because onColumnPropertyEdited() re-loaded the model.
-	SxfData tableData = m_model->getData();
-
-	// 2. Merge it into our master m_sxfData object
-	// m_sxfData already has the latest global properties (scene, fps, note)
-	// from onPropertyEdited().
-	m_sxfData.actionSheet = tableData.actionSheet;
-	m_sxfData.cellSheet = tableData.cellSheet;
-	m_sxfData.property.maxFrames = tableData.property.maxFrames; // Model is authoritative on frame count
+	// The model edits the same document, so it already holds every change.
+	// Short columns are padded to maxFrames as they are written.
 
-	// 3. Save the merged data
+	// The snapshot shares the document's source, which paged columns keep reading
+	// on this thread. Release it here rather than in saveSxf() on the worker.
 	try {
-		saveSxf(filePath, m_sxfData);
+		releaseSxfSource(*m_document, filePath);
 	}
 	catch (const std::runtime_error& e) {
 		QMessageBox::warning(this, "Error", QString("Failed to save SXF file:\n%1").arg(e.what()));
+		return;
+	}
+
+	// Save a snapshot of it on a worker. The copy only shares the implicitly
+	// shared column storage, edits made meanwhile detach from it.
+	SxfData snapshot = *m_document;
+	m_savingPath = filePath;
+	statusBar()->showMessage(QString("Saving %1...").arg(QFileInfo(filePath).fileName()));
+	m_saveWatcher->setFuture(QtConcurrent::run([snapshot, filePath]() mutable {
+		try {
+			saveSxf(filePath, snapshot);
+		}
+		catch (const std::runtime_error& e) {
+			return QString::fromUtf8(e.what());
+		}
+		return QString();
+	}));
+}
+
+/**
+ * @brief Called on the GUI thread when the background save ends.
+ */
+void SxfViewer::onSaveFinished()
+{
+	const QString error = m_saveWatcher->result();
+	if (!error.isEmpty()) {
+		statusBar()->showMessage(QString("Failed to save %1").arg(QFileInfo(m_savingPath).fileName()));
+		QMessageBox::warning(this, "Error", QString("Failed to save SXF file:\n%1").arg(error));
+		return;
 	}
+	statusBar()->showMessage(QString("Saved %1").arg(QFileInfo(m_savingPath).fileName()), 5000);
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define SXFVIEWER_H
 
 #include <QMainWindow>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QFont>
+#include <atomic>
 #include "sxfprocessor.h" // Needed for SxfData
 
 class QTableView;
@@ -17,8 +21,19 @@ class QComboBox;
 class QCheckBox;
 class QGroupBox;
 class QLabel; // For new dock
+class QLineEdit;
+class QProgressDialog;
 // -------------------------
 
+/**
+ * @brief Outcome of a background load, errors are carried back instead of thrown.
+ */
+struct SxfLoadResult {
+    SxfData data;
+    QString error;
+    bool cancelled = false;
+};
+
 class SxfViewer : public QMainWindow
 {
     Q_OBJECT
@@ -29,7 +44,9 @@ public:
 
 private slots:
     void onOpen();
+    void onLoadFinished();
     void onSaveAs();
+    void onSaveFinished();
     void onPropertyEdited(); // Slot for global property changes
 
     // --- New Slots ---
@@ -47,8 +64,28 @@ private:
     // --- New Helper ---
     SxfColumn* getColumnFromData(int logicalIndex);
 
+    // --- Column Layout ---
+    int columnNameWidth(const QString& name);
+    int dataColumnWidth();
+    int frameColumnWidth();
+
     // --- Data ---
-    SxfData m_sxfData; // The viewer now holds the master copy of the data
+    QSharedPointer<SxfData> m_document; // The one copy of the document, shared with m_model
+
+    // Header text widths per column name, valid for m_nameWidthFont
+    QHash<QString, int> m_nameWidthCache;
+    QFont m_nameWidthFont;
+
+    // --- Background Loading ---
+    QFutureWatcher<SxfLoadResult>* m_loadWatcher;
+    QProgressDialog* m_loadProgress = nullptr;
+    QString m_loadingPath;
+    std::atomic<bool> m_cancelLoad{ false };
+    std::atomic<int> m_loadPermille{ -1 }; // Last progress posted to the GUI thread
+
+    // --- Background Saving ---
+    QFutureWatcher<QString>* m_saveWatcher; // Result is the error message, empty on success
+    QString m_savingPath;
 
     // --- Main UI ---
     QTableView* m_tableView;
@@ -85,8 +122,9 @@ private:
 
     // --- New Column Properties UI Widgets ---
     QDockWidget* m_columnPropertyDock;
-    QLabel* m_colNameLabel;
+    QLineEdit* m_colNameEdit;
     QCheckBox* m_colVisibleCheck;
+    QSpinBox* m_colResvSpinBox;
     int m_selectedColumnIndex = -1; // Helper to track current column
 };
 #endif // SXFVIEWER_H
\ No newline at end of file